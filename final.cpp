@@ -16,10 +16,48 @@
  #include <sodium.h>
  #include <fstream>
  #include <map>
+ #include <unordered_map>
+ #include <list>
  #include <limits>
  #include <thread>
  #include <chrono>
  #include <conio.h>
+ #include <vector>
+ #include <algorithm>
+ #include <cstdint>
+ #include <cstring>
+ #include <cstdio>
+ #include <cerrno>
+ #include <mutex>
+ #include <condition_variable>
+ #include <atomic>
+ #include <future>
+ #include <deque>
+ #include <queue>
+ #include <unordered_set>
+ #include <functional>
+ #include <memory>
+ #include <array>
+ #include <type_traits>
+ #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+ #define AUTH_X86_KERNELS  // AVX2 / AVX-512 Argon2 kernels, selected at run time
+ #include <immintrin.h>
+ #endif
+ #ifdef __cpp_impl_coroutine
+ #include <coroutine>
+ #endif
+ #ifdef _WIN32
+ #define NOMINMAX
+ #include <windows.h>
+ #include <psapi.h>
+ #include <io.h>
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #else
+ #include <unistd.h>
+ #include <fcntl.h>
+ #include <sys/resource.h>
+ #endif
  
  using namespace std;
  
@@ -49,6 +87,35 @@
      return password;  // Return the entered password
  }
  
+ /**
+  * @brief Parses a whole string as an unsigned integer or a floating-point number within a range.
+  * @param text The text to parse; it must hold the number and nothing else.
+  * @param value Receives the number on success and is left unchanged otherwise.
+  * @param low The smallest accepted value.
+  * @param high The largest accepted value.
+  * @return true if the text is a number between 'low' and 'high', false otherwise.
+  */
+ template <class T>
+ bool parseNumber(const string& text, T& value, T low, T high) {
+     static_assert(is_unsigned<T>::value || is_floating_point<T>::value, "unsigned or floating-point numbers only");
+     if (text.empty() || !(isdigit(static_cast<unsigned char>(text[0])) || text[0] == '.')) return false;
+     try {
+         size_t used;
+         if constexpr (is_floating_point<T>::value) {
+             double number = stod(text, &used);
+             if (used != text.size() || !(number >= double(low) && number <= double(high))) return false;
+             value = T(number);
+         } else {
+             unsigned long long number = stoull(text, &used);
+             if (used != text.size() || number < low || number > high) return false;
+             value = T(number);
+         }
+         return true;
+     } catch (const logic_error&) {  // invalid_argument or out_of_range
+         return false;
+     }
+ }
+ 
  /**
   * @namespace TerminalColors
   * @brief Contains ANSI escape sequences for terminal text formatting.
@@ -149,19 +216,24 @@
      }
  
      /**
-      * @brief Displays a loading message with dots, simulating a loading process.
+      * @brief Displays a loading message with dots while a background job runs.
+      * @details The animation lasts exactly as long as the job: a dot is printed every
+      *          'milliseconds' until the result is ready.
       * @param message The loading message to display.
-      * @param milliseconds The duration of the loading animation.
+      * @param result The future of the background job.
+      * @param milliseconds The time between two dots.
+      * @return The result of the job; its exception, if any, is rethrown.
       */
-     static void loading(const string& message, int milliseconds = 1500) {
+     template <class T>
+     static T loading(const string& message, future<T> result, int milliseconds = 250) {
          cout << message;
          cout.flush();  // Ensure the message is printed immediately
-         for (int i = 0; i < 3; i++) {
-             this_thread::sleep_for(chrono::milliseconds(milliseconds / 3));  // Wait for a short period
-             cout << ".";  // Print a dot to simulate loading
+         while (result.wait_for(chrono::milliseconds(milliseconds)) != future_status::ready) {
+             cout << ".";  // Print a dot while the job is still running
              cout.flush();  // Ensure the dot is printed immediately
          }
          cout << endl;
+         return result.get();
      }
  };
  
@@ -329,280 +401,4981 @@
  };
  
  /**
-  * @class PasswordHasher
-  * @brief Provides static methods for hashing passwords using the Libsodium library.
+  * @class HashingPool
+  * @brief A fixed-size pool of worker threads that runs password hashing jobs.
+  * @details Jobs are queued and picked up by the first idle worker; submit() returns a future
+  *          for the job's result. The pool is separate from the threads that accept requests,
+  *          so many logins can be hashed in parallel across cores.
   */
- class PasswordHasher {
+ class HashingPool {
+ private:
+     vector<thread> workers;  ///< The worker threads
+     deque<function<void()>> jobs;  ///< Jobs waiting for a worker
+     mutex lock;  ///< Protects 'jobs' and 'stopping'
+     condition_variable wake;  ///< Signals workers that a job is queued
+     bool stopping = false;  ///< Set to make the workers exit once the queue is empty
+ 
+     /**
+      * @brief Worker loop: runs queued jobs until the pool is destroyed.
+      */
+     void run() {
+         while (true) {
+             function<void()> job;
+             {
+                 unique_lock<mutex> guard(lock);
+                 wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+                 if (jobs.empty()) return;
+                 job = move(jobs.front());
+                 jobs.pop_front();
+             }
+             job();
+         }
+     }
+ 
  public:
      /**
-      * @brief Initializes the libsodium library for cryptographic operations.
-      * @return true if initialization is successful, false otherwise.
+      * @brief Constructor: starts the worker threads.
+      * @param threads The number of workers; 0 uses one per hardware thread.
       */
-     static bool initialize() {
-         return sodium_init() >= 0 ? true : (Terminal::printError("Libsodium init failed"), false);
+     explicit HashingPool(size_t threads = 0) {
+         if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+         for (size_t i = 0; i < threads; i++) workers.emplace_back(&HashingPool::run, this);
      }
  
      /**
-      * @brief Generates a random salt for password hashing.
-      * @return The salt as a hexadecimal string.
+      * @brief Queues a job for the workers.
+      * @param job The function to run on a worker thread.
+      * @return A future that holds the job's result or exception.
       */
-     static string generateSalt() {
-         unsigned char salt[crypto_pwhash_SALTBYTES];
-         randombytes_buf(salt, sizeof salt);
+     template <class Job>
+     auto submit(Job job) -> future<decltype(job())> {
+         auto task = make_shared<packaged_task<decltype(job())()>>(move(job));
+         future<decltype(job())> result = task->get_future();
+         {
+             lock_guard<mutex> guard(lock);
+             jobs.emplace_back([task] { (*task)(); });
+         }
+         wake.notify_one();
+         return result;
+     }
+ 
+     /**
+      * @brief Returns the number of worker threads.
+      * @return The number of workers.
+      */
+     size_t size() const { return workers.size(); }
  
-         char hex[2 * crypto_pwhash_SALTBYTES + 1];
-         for (size_t i = 0; i < sizeof salt; i++)
-             snprintf(&hex[i*2], 3, "%02x", salt[i]);
-         return string(hex);
+     /**
+      * @brief Returns the number of jobs waiting for a worker.
+      * @return The queue depth.
+      */
+     size_t pending() {
+         lock_guard<mutex> guard(lock);
+         return jobs.size();
      }
  
      /**
-      * @brief Hashes the password using the given salt.
-      * @param password The password to hash.
-      * @param salt_hex The salt in hexadecimal format.
-      * @return The hashed password as a hexadecimal string.
+      * @brief Destructor: finishes the queued jobs and joins the workers.
+      */
+     ~HashingPool() {
+         {
+             lock_guard<mutex> guard(lock);
+             stopping = true;
+         }
+         wake.notify_all();
+         for (thread& worker : workers) worker.join();
+     }
+ };
+ 
+ /**
+  * @class HashAdmissionGate
+  * @brief Limits the memory used by concurrent password hashes to a configured budget.
+  * @details Every Argon2 call allocates its full memory cost up front. Callers reserve that
+  *          memory before hashing and are admitted in arrival order while the budget allows;
+  *          the others wait in line until a deadline. A single hash larger than the whole
+  *          budget is still admitted when nothing else is running.
+  */
+ class HashAdmissionGate {
+ public:
+     /**
+      * @brief Counters describing the admission queue.
       */
-     static string hashPassword(const string& password, const string& salt_hex) {
-         Terminal::loading("Securely hashing password");
+     struct Stats {
+         size_t queueDepth = 0;  ///< Callers currently waiting for memory
+         uint64_t inFlightBytes = 0;  ///< Memory reserved by running hashes
+         uint64_t admitted = 0;  ///< Hashes admitted so far
+         uint64_t timedOut = 0;  ///< Callers that gave up after their deadline
+         double totalWaitSeconds = 0;  ///< Total time admitted callers spent waiting
+         double maxWaitSeconds = 0;  ///< Longest time an admitted caller waited
+     };
  
-         unsigned char salt[crypto_pwhash_SALTBYTES];
-         for (size_t i = 0; i < crypto_pwhash_SALTBYTES; i++)
-             salt[i] = stoi(salt_hex.substr(i*2, 2), nullptr, 16);
+ private:
+     uint64_t budget;  ///< Maximum memory reserved at once
+     deque<uint64_t> line;  ///< Tickets of the waiting callers, in arrival order
+     uint64_t nextTicket = 0;  ///< Ticket given to the next caller
+     Stats stats;  ///< Queue counters
+     mutex lock;  ///< Protects the members above
+     condition_variable released;  ///< Signals waiters that memory or the head of the line changed
  
-         unsigned char hash[32];
-         if (crypto_pwhash(hash, sizeof hash, password.c_str(), password.size(),
-                           salt, crypto_pwhash_OPSLIMIT_MODERATE, 
-                           crypto_pwhash_MEMLIMIT_MODERATE, crypto_pwhash_ALG_DEFAULT) != 0)
-             throw runtime_error("Hashing failed");
+ public:
+     /**
+      * @brief Constructor: sets the memory budget.
+      * @param bytes The maximum memory reserved by concurrent hashes.
+      */
+     explicit HashAdmissionGate(uint64_t bytes) : budget(bytes) {}
  
-         char hex[65];
-         for (size_t i = 0; i < sizeof hash; i++)
-             snprintf(&hex[i*2], 3, "%02x", hash[i]);
-         return string(hex);
+     /**
+      * @brief Changes the memory budget.
+      * @param bytes The maximum memory reserved by concurrent hashes.
+      */
+     void setBudget(uint64_t bytes) {
+         lock_guard<mutex> guard(lock);
+         budget = bytes;
+         released.notify_all();
      }
  
      /**
-      * @brief Verifies if the given password matches the stored hash.
-      * @param password The password to verify.
-      * @param hash The stored hash.
-      * @param salt The salt used for hashing.
-      * @return true if the password matches the hash, false otherwise.
+      * @brief Returns the memory budget.
+      * @return The maximum memory reserved by concurrent hashes.
       */
-     static bool verifyPassword(const string& password, const string& hash, const string& salt) {
-         try {
-             return hash == hashPassword(password, salt);
-         } catch (...) {
+     uint64_t getBudget() {
+         lock_guard<mutex> guard(lock);
+         return budget;
+     }
+ 
+     /**
+      * @brief Waits until 'bytes' of memory can be reserved, in arrival order.
+      * @param bytes The memory the hash will allocate.
+      * @param timeout How long to wait before giving up.
+      * @return true if the memory was reserved, false if the deadline passed.
+      */
+     bool acquire(uint64_t bytes, chrono::milliseconds timeout) {
+         auto start = chrono::steady_clock::now();
+         unique_lock<mutex> guard(lock);
+         uint64_t ticket = nextTicket++;
+         line.push_back(ticket);
+         stats.queueDepth = line.size();
+ 
+         bool admitted = released.wait_until(guard, start + timeout, [&] {
+             return line.front() == ticket &&
+                    (stats.inFlightBytes + bytes <= budget || stats.inFlightBytes == 0);
+         });
+         line.erase(find(line.begin(), line.end(), ticket));
+         stats.queueDepth = line.size();
+         released.notify_all();  // The next caller may now be at the head of the line
+ 
+         if (!admitted) {
+             stats.timedOut++;
              return false;
          }
+         double waited = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+         stats.inFlightBytes += bytes;
+         stats.admitted++;
+         stats.totalWaitSeconds += waited;
+         stats.maxWaitSeconds = max(stats.maxWaitSeconds, waited);
+         return true;
+     }
+ 
+     /**
+      * @brief Returns memory reserved by acquire().
+      * @param bytes The memory to return.
+      */
+     void release(uint64_t bytes) {
+         lock_guard<mutex> guard(lock);
+         stats.inFlightBytes -= bytes;
+         released.notify_all();
+     }
+ 
+     /**
+      * @brief Returns the queue counters.
+      * @return The queue depth, reserved memory and wait times.
+      */
+     Stats snapshot() {
+         lock_guard<mutex> guard(lock);
+         return stats;
      }
  };
  
  /**
-  * @class Database
-  * @brief Provides static methods to interact with a database of users.
+  * @class SaltPool
+  * @brief A ring of random salts kept full by a background thread.
+  * @details Registration bursts take ready-made salts instead of calling the random number
+  *          generator for each one. Taking a salt claims the next full slot with a single
+  *          compare-and-swap on the read index; the refill thread is woken once the ring is
+  *          half empty. When the ring runs dry, callers draw a salt directly.
   */
- class Database {
- private:
-     static map<string, pair<string, string>> users;  ///< A map to store users and their credentials (hash, salt)
-     static const string filename;  ///< The filename to save/load user data
- 
+ class SaltPool {
  public:
+     static const size_t saltBytes = crypto_pwhash_SALTBYTES;  ///< Size of each salt
+ 
+ private:
      /**
-      * @brief Loads user data from a file into the 'users' map.
+      * @brief One salt; 'sequence' says whether it is ready to take or free to refill.
       */
-     static void loadUsers() {
-         ifstream file(filename);
-         if (!file) return;
+     struct alignas(64) Slot {
+         atomic<size_t> sequence;  ///< Equals position + 1 when full, position when free
+         unsigned char salt[saltBytes];  ///< The salt bytes
+     };
  
-         string line;
-         while (getline(file, line)) {
-             size_t pos1 = line.find(','), pos2 = line.find(',', pos1 + 1);
-             if (pos1 == string::npos || pos2 == string::npos) continue;
+     const size_t capacity;  ///< Number of slots, a power of two
+     unique_ptr<Slot[]> slots;  ///< The ring
+     alignas(64) atomic<size_t> head;  ///< Position of the next salt to take
+     alignas(64) atomic<size_t> tail;  ///< Position of the next slot to fill; written by the refill thread
+     atomic<uint64_t> misses;  ///< Salts drawn directly because the ring was empty
+     atomic<bool> refillRequested;  ///< Set once per refill so takers notify only once
+     mutex lock;  ///< Protects 'stopping' and the refill wake-up
+     condition_variable wake;  ///< Wakes the refill thread
+     bool stopping = false;  ///< Set to make the refill thread exit
+     thread refiller;  ///< The refill thread
+ 
+     /**
+      * @brief Refill loop: fills every free slot, then sleeps until the ring is half empty.
+      */
+     void run() {
+         const size_t batch = 64;
+         vector<unsigned char> fresh(batch * saltBytes);
+         while (true) {
+             refillRequested = false;  // Requests made while filling below are kept
+             size_t position = tail.load(memory_order_relaxed);
+             for (size_t filled = 0;; filled++, position++) {
+                 Slot& slot = slots[position & (capacity - 1)];
+                 if (slot.sequence.load(memory_order_acquire) != position) break;  // Ring is full
+                 if (filled % batch == 0) randombytes_buf(fresh.data(), fresh.size());
+                 memcpy(slot.salt, &fresh[(filled % batch) * saltBytes], saltBytes);
+                 slot.sequence.store(position + 1, memory_order_release);
+                 tail.store(position + 1, memory_order_release);
+             }
+             sodium_memzero(fresh.data(), fresh.size());
  
-             users[line.substr(0, pos1)] = make_pair(
-                 line.substr(pos1 + 1, pos2 - pos1 - 1),
-                 line.substr(pos2 + 1)
-             );
+             unique_lock<mutex> guard(lock);
+             wake.wait(guard, [this] { return stopping || refillRequested; });
+             if (stopping) return;
          }
      }
  
      /**
-      * @brief Saves the current users data from the 'users' map to the file.
+      * @brief Wakes the refill thread unless a wake-up is already pending.
       */
-     static void saveUsers() {
-         ofstream file(filename);
-         for (const auto& [user, data] : users)
-             file << user << "," << data.first << "," << data.second << endl;
+     void requestRefill() {
+         if (refillRequested.exchange(true)) return;
+         lock_guard<mutex> guard(lock);
+         wake.notify_one();
      }
  
+ public:
      /**
-      * @brief Checks if a user exists in the 'users' map.
-      * @param username The username to check.
-      * @return true if the user exists, false otherwise.
+      * @brief Constructor: allocates the ring and starts the refill thread.
+      * @param size The number of salts kept ready, rounded up to a power of two.
       */
-     static bool userExists(const string& username) {
-         return users.find(username) != users.end();
+     explicit SaltPool(size_t size = 1024)
+         : capacity(size <= 2 ? 2 : size_t(1) << (64 - __builtin_clzll(size - 1))),
+           slots(new Slot[capacity]), head(0), tail(0), misses(0), refillRequested(false) {
+         for (size_t i = 0; i < capacity; i++) slots[i].sequence.store(i, memory_order_relaxed);
+         refiller = thread(&SaltPool::run, this);
      }
  
      /**
-      * @brief Adds a new user to the 'users' map with the provided credentials.
-      * @param username The username of the new user.
-      * @param hash The hashed password.
-      * @param salt The salt used for hashing.
-      * @return true if the user is added successfully, false otherwise.
+      * @brief Copies the next ready salt, or a freshly drawn one if the ring is empty.
+      * @param out Receives saltBytes bytes.
       */
-     static bool addUser(const string& username, const string& hash, const string& salt) {
-         if (userExists(username)) return false;
-         users[username] = {hash, salt};
-         saveUsers();
-         return true;
+     void take(unsigned char* out) {
+         size_t position = head.load(memory_order_relaxed);
+         while (true) {
+             Slot& slot = slots[position & (capacity - 1)];
+             size_t sequence = slot.sequence.load(memory_order_acquire);
+             if (sequence != position + 1) {
+                 if (sequence < position + 1) break;  // Ring is empty
+                 position = head.load(memory_order_relaxed);  // Another taker got there first
+                 continue;
+             }
+             if (!head.compare_exchange_weak(position, position + 1, memory_order_relaxed)) continue;
+             memcpy(out, slot.salt, saltBytes);
+             slot.sequence.store(position + capacity, memory_order_release);
+             if (available() < capacity / 2) requestRefill();
+             return;
+         }
+         misses++;
+         requestRefill();
+         randombytes_buf(out, saltBytes);
      }
  
      /**
-      * @brief Retrieves the hash and salt for a given username.
-      * @param username The username to retrieve credentials for.
-      * @param hash The hash to store.
-      * @param salt The salt to store.
-      * @return true if credentials are found, false otherwise.
+      * @brief Returns the number of salts ready to take.
+      * @return An estimate; it may be stale by the time it is used.
       */
-     static bool getCredentials(const string& username, string& hash, string& salt) {
-         auto it = users.find(username);
-         if (it == users.end()) return false;
-         hash = it->second.first;
-         salt = it->second.second;
-         return true;
+     size_t available() const {
+         size_t taken = head.load(memory_order_relaxed), filled = tail.load(memory_order_relaxed);
+         return filled > taken ? filled - taken : 0;
      }
  
      /**
-      * @brief Returns the number of users in the 'users' map.
-      * @return The number of users.
+      * @brief Returns how many salts had to be drawn directly because the ring was empty.
+      * @return The miss count since start-up.
       */
-     static int userCount() { return users.size(); }
- };
+     uint64_t missCount() const { return misses; }
+ 
+     /**
+      * @brief Destructor: stops and joins the refill thread.
+      */
+     ~SaltPool() {
+         {
+             lock_guard<mutex> guard(lock);
+             stopping = true;
+         }
+         wake.notify_one();
+         refiller.join();
+     }
  
- map<string, pair<string, string>> Database::users;  ///< Static member variable that holds user data
- const string Database::filename = "users.txt";  ///< Static constant string for the filename to store user data
+ };
  
  /**
-  * @brief Displays the login screen and verifies user credentials.
+  * @class Argon2
+  * @brief A portable Argon2id (version 1.3, RFC 9106) with support for several lanes.
+  * @details libsodium always runs Argon2 with one lane. Here the memory is split into p lanes
+  *          that are filled in parallel on a dedicated set of threads, synchronising after each
+  *          of the four slices of every pass. The total memory (the hardness budget) does not
+  *          depend on p, while the time of a single hash drops roughly by p. With one lane the
+  *          output is identical to crypto_pwhash with crypto_pwhash_ALG_ARGON2ID13.
+  *          In arena mode hashes borrow pre-faulted memory matrices from a bounded pool instead
+  *          of allocating and freeing them every time. The block compression runs on a portable,
+  *          an AVX2 or an AVX-512 kernel, picked at start-up from what the CPU supports.
   */
- void loginScreen() {
-     Terminal::printHeader("User Login");
-     string username, password;
-     cout << "Username: ";
-     getline(cin, username);
-     if (username.empty()) {
-         Terminal::printError("Username required");
-         Terminal::waitForEnter();
-         return;
+ class Argon2 {
+ public:
+     /**
+      * @brief One 1 KiB block of Argon2 memory.
+      */
+     struct alignas(64) Block {
+         uint64_t v[128];  ///< The block as 128 little-endian 64-bit words
+     };
+ 
+     /**
+      * @brief Implementations of the block compression function.
+      */
+     enum class Kernel { Portable, Avx2, Avx512 };
+ 
+     static const uint32_t version = 0x13;  ///< Argon2 version 1.3
+     static const uint32_t typeId = 2;  ///< Argon2id
+ 
+ private:
+     static const uint32_t syncPoints = 4;  ///< Slices per pass
+     static atomic<bool> reuseArenas;  ///< true to hash in pooled arenas
+     static Kernel kernel;  ///< The compression kernel in use
+ 
+     /**
+      * @brief Gives an arena back to arenas() when a hash is done with it, or frees a one-off buffer.
+      */
+     struct ArenaReturn {
+         size_t blocks = 0;  ///< Size of the arena in blocks
+         bool pooled = false;  ///< false for a buffer allocated outside the pool's capacity
+         void operator()(Block* memory) const;
+     };
+ 
+     using Arena = unique_ptr<Block[], ArenaReturn>;  ///< A memory matrix lent to one hash
+ 
+     /**
+      * @class ArenaPool
+      * @brief Pre-faulted memory matrices shared by the hashing threads within a memory capacity.
+      * @details Every pooled arena, idle or lent, counts against the capacity, which is the
+      *          admission budget, so memory kept between hashes is never on top of what the
+      *          admission gate allows. A hash reuses an idle arena only if it is no larger than
+      *          the memory the hash was admitted for; otherwise idle arenas are freed, largest
+      *          first, to make room for a new one. Arenas larger than the configured cost are
+      *          freed when they come back instead of being kept.
+      */
+     class ArenaPool {
+     private:
+         mutex lock;  ///< Protects the members below
+         multimap<size_t, unique_ptr<Block[]>> idle;  ///< Arenas not lent out, by size in blocks
+         size_t resident = 0;  ///< Blocks in all pooled arenas, idle or lent
+         size_t capacity = 0;  ///< Most blocks kept in pooled arenas
+         size_t largest = 0;  ///< Largest arena kept after use, in blocks
+ 
+         /**
+          * @brief Moves out idle arenas over the size limit, then the largest ones until 'room'
+          *        more blocks fit within the capacity; the caller frees them outside the lock.
+          */
+         void trim(size_t room, vector<unique_ptr<Block[]>>& freed) {
+             for (auto it = idle.begin(); it != idle.end();) {
+                 if (it->first <= largest) { ++it; continue; }
+                 resident -= it->first;
+                 freed.push_back(move(it->second));
+                 it = idle.erase(it);
+             }
+             while (resident + room > capacity && !idle.empty()) {
+                 auto biggest = prev(idle.end());
+                 resident -= biggest->first;
+                 freed.push_back(move(biggest->second));
+                 idle.erase(biggest);
+             }
+         }
+ 
+     public:
+         /**
+          * @brief Sets the capacity and the largest arena kept, freeing idle arenas beyond them.
+          * @param capacityBlocks Most blocks kept in pooled arenas.
+          * @param largestBlocks Largest arena kept after use.
+          */
+         void setLimits(size_t capacityBlocks, size_t largestBlocks) {
+             vector<unique_ptr<Block[]>> freed;  // Declared first, so freed after the lock is released
+             lock_guard<mutex> guard(lock);
+             capacity = capacityBlocks;
+             largest = largestBlocks;
+             trim(0, freed);
+         }
+ 
+         /**
+          * @brief Frees every idle arena.
+          */
+         void clear() {
+             vector<unique_ptr<Block[]>> freed;
+             lock_guard<mutex> guard(lock);
+             for (auto& arena : idle) {
+                 resident -= arena.first;
+                 freed.push_back(move(arena.second));
+             }
+             idle.clear();
+         }
+ 
+         /**
+          * @brief Lends an arena of at least 'blocks' blocks to a hash.
+          * @param blocks The blocks the hash needs.
+          * @param admittedBlocks The memory the hash was admitted for, in blocks.
+          * @return A pre-faulted arena that goes back to the pool when destroyed.
+          */
+         Arena take(size_t blocks, size_t admittedBlocks) {
+             vector<unique_ptr<Block[]>> freed;
+             bool pooled;
+             {
+                 lock_guard<mutex> guard(lock);
+                 auto fit = idle.lower_bound(blocks);
+                 if (fit != idle.end() && fit->first <= max(blocks, admittedBlocks)) {
+                     ArenaReturn owner{ fit->first, true };
+                     Arena arena(fit->second.release(), owner);
+                     idle.erase(fit);
+                     return arena;
+                 }
+                 trim(blocks, freed);
+                 pooled = resident + blocks <= capacity;  // Else only a hash larger than the budget runs
+                 if (pooled) resident += blocks;
+             }
+             freed.clear();
+             Arena arena(new Block[blocks], ArenaReturn{ blocks, pooled });
+             // Touch every page now, so hashes reusing this arena never take page faults
+             const size_t page = 4096;
+             unsigned char* bytes = reinterpret_cast<unsigned char*>(arena.get());
+             for (size_t offset = 0; offset < blocks * sizeof(Block); offset += page) bytes[offset] = 0;
+             return arena;
+         }
+ 
+         /**
+          * @brief Keeps an arena a hash is done with, or frees it if the pool is over its limits.
+          * @param memory The arena.
+          * @param blocks Its size in blocks.
+          */
+         void giveBack(Block* memory, size_t blocks) {
+             unique_ptr<Block[]> arena(memory);  // Declared first, so freed after the lock is released
+             lock_guard<mutex> guard(lock);
+             if (blocks > largest || resident > capacity) {
+                 resident -= blocks;
+                 return;
+             }
+             idle.emplace(blocks, move(arena));
+         }
+ 
+         /**
+          * @brief Returns the memory held by pooled arenas.
+          * @return Blocks in idle and lent arenas.
+          */
+         size_t residentBlocks() {
+             lock_guard<mutex> guard(lock);
+             return resident;
+         }
+     };
+ 
+     /**
+      * @brief Returns the arena pool shared by all hashing threads.
+      */
+     static ArenaPool& arenas() {
+         static ArenaPool pool;
+         return pool;
      }
  
-     password = getPasswordFromUser("Password: ");
-     string storedHash, storedSalt;
-     if (!Database::getCredentials(username, storedHash, storedSalt)) {
-         Terminal::printError("User not found");
-         Terminal::waitForEnter();
-         return;
+     /**
+      * @brief Position of the segment being filled.
+      */
+     struct Position {
+         uint32_t pass;  ///< Current pass
+         uint32_t lane;  ///< Current lane
+         uint32_t slice;  ///< Current slice
+     };
+ 
+     /**
+      * @brief Memory layout of one hash computation.
+      */
+     struct Instance {
+         Block* memory;  ///< All lanes, one after the other
+         uint32_t passes;  ///< Number of passes (t)
+         uint32_t memoryBlocks;  ///< Number of blocks, rounded down to a multiple of 4p
+         uint32_t laneLength;  ///< Blocks per lane
+         uint32_t segmentLength;  ///< Blocks per segment
+         uint32_t lanes;  ///< Number of lanes (p)
+     };
+ 
+     static uint64_t rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+ 
+     /**
+      * @brief The BlaMka mixing function: x + y + 2 * lo32(x) * lo32(y).
+      */
+     static uint64_t blaMka(uint64_t x, uint64_t y) {
+         return x + y + 2 * (x & 0xffffffffULL) * (y & 0xffffffffULL);
      }
  
-     if (PasswordHasher::verifyPassword(password, storedHash, storedSalt)) {
-         Terminal::printSuccess("Login successful!");
-         cout << TerminalColors::Magenta << "\nWelcome to your secure account, " 
-              << username << "!" << TerminalColors::Reset << endl;
-     } else {
-         Terminal::printError("Invalid credentials");
+     /**
+      * @brief The BLAKE2b G function with BlaMka additions.
+      */
+     static void mix(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d) {
+         a = blaMka(a, b); d = rotr(d ^ a, 32);
+         c = blaMka(c, d); b = rotr(b ^ c, 24);
+         a = blaMka(a, b); d = rotr(d ^ a, 16);
+         c = blaMka(c, d); b = rotr(b ^ c, 63);
      }
-     Terminal::waitForEnter();
- }
  
- /**
-  * @brief Displays the registration screen and prompts the user to create a new account.
-  */
- void registrationScreen() {
-     Terminal::printHeader("New Account Registration");
+     /**
+      * @brief One BLAKE2b round without message words over 16 words.
+      */
+     static void permute(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3,
+                         uint64_t& v4, uint64_t& v5, uint64_t& v6, uint64_t& v7,
+                         uint64_t& v8, uint64_t& v9, uint64_t& v10, uint64_t& v11,
+                         uint64_t& v12, uint64_t& v13, uint64_t& v14, uint64_t& v15) {
+         mix(v0, v4, v8, v12); mix(v1, v5, v9, v13); mix(v2, v6, v10, v14); mix(v3, v7, v11, v15);
+         mix(v0, v5, v10, v15); mix(v1, v6, v11, v12); mix(v2, v7, v8, v13); mix(v3, v4, v9, v14);
+     }
  
-     User newUser;
-     string username;
-     cout << "Username: ";
-     getline(cin, username);
-     if (username.empty()) {
-         Terminal::printError("Username required");
-         Terminal::waitForEnter();
-         return;
+     /**
+      * @brief The compression function G: next = P(prev ^ ref) ^ prev ^ ref (^ next).
+      * @param prev The previous block.
+      * @param ref The reference block.
+      * @param next The block to write.
+      * @param withXor true to XOR the result into 'next' (passes after the first).
+      */
+     static void fillBlock(const Block& prev, const Block& ref, Block& next, bool withXor) {
+ #ifdef AUTH_X86_KERNELS
+         if (kernel == Kernel::Avx512) return fillBlockAvx512(prev, ref, next, withXor);
+         if (kernel == Kernel::Avx2) return fillBlockAvx2(prev, ref, next, withXor);
+ #endif
+         fillBlockPortable(prev, ref, next, withXor);
      }
  
-     for (char c : username) {
-         if (!isalnum(c)) {
-             Terminal::printError("Only alphanumeric characters allowed");
-             Terminal::waitForEnter();
-             return;
+     /**
+      * @brief Portable compression: one BLAKE2b round at a time on 64-bit words.
+      */
+     static void fillBlockPortable(const Block& prev, const Block& ref, Block& next, bool withXor) {
+         Block r, tmp;
+         for (int i = 0; i < 128; i++) r.v[i] = prev.v[i] ^ ref.v[i];
+         tmp = r;
+         if (withXor)
+             for (int i = 0; i < 128; i++) tmp.v[i] ^= next.v[i];
+ 
+         for (int i = 0; i < 8; i++) {  // Rows
+             uint64_t* v = r.v + 16 * i;
+             permute(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+                     v[8], v[9], v[10], v[11], v[12], v[13], v[14], v[15]);
+         }
+         for (int i = 0; i < 8; i++) {  // Columns
+             uint64_t* v = r.v + 2 * i;
+             permute(v[0], v[1], v[16], v[17], v[32], v[33], v[48], v[49],
+                     v[64], v[65], v[80], v[81], v[96], v[97], v[112], v[113]);
          }
+ 
+         for (int i = 0; i < 128; i++) next.v[i] = tmp.v[i] ^ r.v[i];
      }
  
-     if (Database::userExists(username)) {
-         Terminal::printError("Username already taken");
-         Terminal::waitForEnter();
-         return;
+ #ifdef AUTH_X86_KERNELS
+     // The permutation P works on 8 pairs of words: in a row pair k starts at word 2k, in a
+     // column at word 16k. Lanes of a vector are the four columns of the BLAKE2b state, so
+     // one vector G does four G calls and the diagonal step is a rotation of B, C and D.
+ 
+     __attribute__((target("avx2")))
+     static __m256i loadPairs(const uint64_t* v, int stride) {
+         __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v));
+         __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + stride));
+         return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
      }
  
-     newUser.setUsername(username);
-     Terminal::printInfo("Password Requirements:\n"
-         "- Minimum 12 characters\n"
-         "- At least 1 uppercase, 1 lowercase\n"
-         "- At least 1 digit and 1 special character");
+     __attribute__((target("avx2")))
+     static void storePairs(uint64_t* v, int stride, __m256i x) {
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(v), _mm256_castsi256_si128(x));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(v + stride), _mm256_extracti128_si256(x, 1));
+     }
  
-     bool passwordSet = false;
-     while (!passwordSet) {
-         string pw = getPasswordFromUser("Enter password: ");
-         if (pw.empty()) {
-             Terminal::printError("Password cannot be empty");
-             continue;
-         }
-         passwordSet = newUser.setPassword(pw);
+     __attribute__((target("avx2")))
+     static __m256i rotr256(__m256i x, int n) {
+         return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n));
      }
  
-     string salt = PasswordHasher::generateSalt();
-     string hash = PasswordHasher::hashPassword(newUser.getPassword(), salt);
-     if (Database::addUser(username, hash, salt)) {
-         Terminal::printSuccess("Account created successfully!");
-     } else {
-         Terminal::printError("Account creation failed");
+     __attribute__((target("avx2")))
+     static __m256i blaMka256(__m256i x, __m256i y) {
+         __m256i product = _mm256_mul_epu32(x, y);
+         return _mm256_add_epi64(_mm256_add_epi64(x, y), _mm256_add_epi64(product, product));
      }
-     Terminal::waitForEnter();
- }
  
- /**
-  * @brief Main function to run the authentication system.
-  * @return 0 on successful execution.
-  */
- int main() {
-     if (!PasswordHasher::initialize()) return 1;
-     Database::loadUsers();
+     __attribute__((target("avx2")))
+     static void mix256(__m256i& a, __m256i& b, __m256i& c, __m256i& d) {
+         a = blaMka256(a, b); d = rotr256(_mm256_xor_si256(d, a), 32);
+         c = blaMka256(c, d); b = rotr256(_mm256_xor_si256(b, c), 24);
+         a = blaMka256(a, b); d = rotr256(_mm256_xor_si256(d, a), 16);
+         c = blaMka256(c, d); b = rotr256(_mm256_xor_si256(b, c), 63);
+     }
  
-     while (true) {
-         Terminal::printHeader("Secure Authentication System");
-         cout << TerminalColors::Bold << "[Main Menu]\n" << TerminalColors::Reset
-              << "Registered users: " << Database::userCount() << "\n\n"
-              << "1. Login\n2. Register\n3. Exit\n\nChoice (1-3): ";
+     /**
+      * @brief Applies P to the 8 word pairs at v, v + stride, ..., v + 7 * stride.
+      */
+     __attribute__((target("avx2")))
+     static void permuteAvx2(uint64_t* v, int stride) {
+         __m256i a = loadPairs(v, stride), b = loadPairs(v + 2 * stride, stride);
+         __m256i c = loadPairs(v + 4 * stride, stride), d = loadPairs(v + 6 * stride, stride);
+         mix256(a, b, c, d);
+         b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));  // Diagonalize
+         c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+         d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+         mix256(a, b, c, d);
+         b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));  // Undiagonalize
+         c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+         d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+         storePairs(v, stride, a); storePairs(v + 2 * stride, stride, b);
+         storePairs(v + 4 * stride, stride, c); storePairs(v + 6 * stride, stride, d);
+     }
  
-         int choice;
-         if (!(cin >> choice)) {
-             cin.clear();
-             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-             Terminal::printError("Invalid input");
-             this_thread::sleep_for(chrono::seconds(1));
-             continue;
-         }
-         cin.ignore();
+     /**
+      * @brief AVX2 compression: one permutation per step, four G calls per instruction.
+      */
+     __attribute__((target("avx2")))
+     static void fillBlockAvx2(const Block& prev, const Block& ref, Block& next, bool withXor) {
+         Block r, tmp;
+         for (int i = 0; i < 128; i++) r.v[i] = prev.v[i] ^ ref.v[i];
+         tmp = r;
+         if (withXor)
+             for (int i = 0; i < 128; i++) tmp.v[i] ^= next.v[i];
+         for (int i = 0; i < 8; i++) permuteAvx2(r.v + 16 * i, 2);  // Rows
+         for (int i = 0; i < 8; i++) permuteAvx2(r.v + 2 * i, 16);  // Columns
+         for (int i = 0; i < 128; i++) next.v[i] = tmp.v[i] ^ r.v[i];
+     }
  
-         switch (choice) {
-             case 1:
-                 loginScreen();
-                 break;
-             case 2:
-                 registrationScreen();
-                 break;
-             case 3:
+     // GCC 12 reports its own AVX-512 intrinsic headers as reading uninitialized values.
+ #pragma GCC diagnostic push
+ #pragma GCC diagnostic ignored "-Wuninitialized"
+     __attribute__((target("avx512f")))
+     static __m512i loadPairs512(const uint64_t* first, const uint64_t* second, int stride) {
+         __m256i low = _mm256_inserti128_si256(_mm256_castsi128_si256(
+             _mm_loadu_si128(reinterpret_cast<const __m128i*>(first))),
+             _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + stride)), 1);
+         __m256i high = _mm256_inserti128_si256(_mm256_castsi128_si256(
+             _mm_loadu_si128(reinterpret_cast<const __m128i*>(second))),
+             _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + stride)), 1);
+         return _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1);
+     }
+ 
+     __attribute__((target("avx512f")))
+     static void storePairs512(uint64_t* first, uint64_t* second, int stride, __m512i x) {
+         __m256i low = _mm512_castsi512_si256(x), high = _mm512_extracti64x4_epi64(x, 1);
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(first), _mm256_castsi256_si128(low));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(first + stride), _mm256_extracti128_si256(low, 1));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(second), _mm256_castsi256_si128(high));
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(second + stride), _mm256_extracti128_si256(high, 1));
+     }
+ 
+     __attribute__((target("avx512f")))
+     static __m512i blaMka512(__m512i x, __m512i y) {
+         __m512i product = _mm512_mul_epu32(x, y);
+         return _mm512_add_epi64(_mm512_add_epi64(x, y), _mm512_add_epi64(product, product));
+     }
+ 
+     __attribute__((target("avx512f")))
+     static void mix512(__m512i& a, __m512i& b, __m512i& c, __m512i& d) {
+         a = blaMka512(a, b); d = _mm512_ror_epi64(_mm512_xor_si512(d, a), 32);
+         c = blaMka512(c, d); b = _mm512_ror_epi64(_mm512_xor_si512(b, c), 24);
+         a = blaMka512(a, b); d = _mm512_ror_epi64(_mm512_xor_si512(d, a), 16);
+         c = blaMka512(c, d); b = _mm512_ror_epi64(_mm512_xor_si512(b, c), 63);
+     }
+ 
+     /**
+      * @brief Applies P to two independent groups of 8 word pairs at once.
+      */
+     __attribute__((target("avx512f")))
+     static void permuteAvx512(uint64_t* first, uint64_t* second, int stride) {
+         __m512i a = loadPairs512(first, second, stride);
+         __m512i b = loadPairs512(first + 2 * stride, second + 2 * stride, stride);
+         __m512i c = loadPairs512(first + 4 * stride, second + 4 * stride, stride);
+         __m512i d = loadPairs512(first + 6 * stride, second + 6 * stride, stride);
+         mix512(a, b, c, d);
+         b = _mm512_permutex_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));  // Diagonalize each half
+         c = _mm512_permutex_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+         d = _mm512_permutex_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+         mix512(a, b, c, d);
+         b = _mm512_permutex_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));  // Undiagonalize
+         c = _mm512_permutex_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+         d = _mm512_permutex_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+         storePairs512(first, second, stride, a);
+         storePairs512(first + 2 * stride, second + 2 * stride, stride, b);
+         storePairs512(first + 4 * stride, second + 4 * stride, stride, c);
+         storePairs512(first + 6 * stride, second + 6 * stride, stride, d);
+     }
+ 
+     /**
+      * @brief AVX-512 compression: two permutations per step, eight G calls per instruction.
+      */
+     __attribute__((target("avx512f")))
+     static void fillBlockAvx512(const Block& prev, const Block& ref, Block& next, bool withXor) {
+         Block r, tmp;
+         for (int i = 0; i < 128; i++) r.v[i] = prev.v[i] ^ ref.v[i];
+         tmp = r;
+         if (withXor)
+             for (int i = 0; i < 128; i++) tmp.v[i] ^= next.v[i];
+         for (int i = 0; i < 8; i += 2) permuteAvx512(r.v + 16 * i, r.v + 16 * (i + 1), 2);  // Rows
+         for (int i = 0; i < 8; i += 2) permuteAvx512(r.v + 2 * i, r.v + 2 * (i + 1), 16);  // Columns
+         for (int i = 0; i < 128; i++) next.v[i] = tmp.v[i] ^ r.v[i];
+     }
+ #pragma GCC diagnostic pop
+ #endif
+ 
+     /**
+      * @brief Returns the fastest kernel the CPU supports.
+      */
+     static Kernel detectKernel() {
+ #ifdef AUTH_X86_KERNELS
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("avx512f")) return Kernel::Avx512;
+         if (__builtin_cpu_supports("avx2")) return Kernel::Avx2;
+ #endif
+         return Kernel::Portable;
+     }
+ 
+     /**
+      * @brief Writes a 32-bit little-endian integer.
+      */
+     static void store32(unsigned char* out, uint32_t value) {
+         for (int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (8 * i));
+     }
+ 
+     /**
+      * @brief Hashes a length-prefixed string into a BLAKE2b state.
+      */
+     static void updateWithLength(crypto_generichash_state& state, const unsigned char* data, size_t length) {
+         unsigned char prefix[4];
+         store32(prefix, length);
+         crypto_generichash_update(&state, prefix, sizeof prefix);
+         if (length) crypto_generichash_update(&state, data, length);
+     }
+ 
+     /**
+      * @brief The variable-length hash H' built from BLAKE2b.
+      */
+     static void blake2bLong(unsigned char* out, size_t outlen, const unsigned char* in, size_t inlen) {
+         crypto_generichash_state state;
+         unsigned char prefix[4];
+         store32(prefix, outlen);
+         if (outlen <= crypto_generichash_BYTES_MAX) {
+             crypto_generichash_init(&state, nullptr, 0, outlen);
+             crypto_generichash_update(&state, prefix, sizeof prefix);
+             crypto_generichash_update(&state, in, inlen);
+             crypto_generichash_final(&state, out, outlen);
+             return;
+         }
+ 
+         unsigned char current[64], next[64];
+         crypto_generichash_init(&state, nullptr, 0, sizeof current);
+         crypto_generichash_update(&state, prefix, sizeof prefix);
+         crypto_generichash_update(&state, in, inlen);
+         crypto_generichash_final(&state, current, sizeof current);
+         memcpy(out, current, 32);
+         out += 32;
+         size_t remaining = outlen - 32;
+         while (remaining > 64) {
+             crypto_generichash(next, sizeof next, current, sizeof current, nullptr, 0);
+             memcpy(out, next, 32);
+             memcpy(current, next, sizeof current);
+             out += 32;
+             remaining -= 32;
+         }
+         crypto_generichash(out, remaining, current, sizeof current, nullptr, 0);
+     }
+ 
+     /**
+      * @brief Generates the next block of pseudo-random addresses (data-independent indexing).
+      */
+     static void nextAddresses(Block& addresses, Block& input) {
+         static const Block zero = {};
+         input.v[6]++;
+         fillBlock(zero, input, addresses, false);
+         fillBlock(zero, addresses, addresses, false);
+     }
+ 
+     /**
+      * @brief Maps a pseudo-random value to the index of the reference block in its lane.
+      */
+     static uint32_t referenceIndex(const Instance& instance, const Position& position, uint32_t index,
+                                    uint32_t pseudoRandom, bool sameLane) {
+         uint32_t areaSize;
+         if (position.pass == 0) {
+             if (position.slice == 0) areaSize = index - 1;
+             else if (sameLane) areaSize = position.slice * instance.segmentLength + index - 1;
+             else areaSize = position.slice * instance.segmentLength - (index == 0 ? 1 : 0);
+         } else {
+             if (sameLane) areaSize = instance.laneLength - instance.segmentLength + index - 1;
+             else areaSize = instance.laneLength - instance.segmentLength - (index == 0 ? 1 : 0);
+         }
+ 
+         uint64_t relative = pseudoRandom;
+         relative = relative * relative >> 32;
+         relative = areaSize - 1 - (uint64_t(areaSize) * relative >> 32);
+ 
+         uint32_t start = 0;
+         if (position.pass != 0 && position.slice != syncPoints - 1)
+             start = (position.slice + 1) * instance.segmentLength;
+         return uint32_t((start + relative) % instance.laneLength);
+     }
+ 
+     /**
+      * @brief Fills one segment of one lane.
+      */
+     static void fillSegment(const Instance& instance, Position position) {
+         // Argon2id indexes independently of the data in the first half of the first pass
+         bool independent = position.pass == 0 && position.slice < syncPoints / 2;
+         Block addresses = {}, input = {};
+         if (independent) {
+             input.v[0] = position.pass;
+             input.v[1] = position.lane;
+             input.v[2] = position.slice;
+             input.v[3] = instance.memoryBlocks;
+             input.v[4] = instance.passes;
+             input.v[5] = typeId;
+         }
+ 
+         uint32_t startIndex = 0;
+         if (position.pass == 0 && position.slice == 0) {
+             startIndex = 2;  // The first two blocks of each lane come from H0
+             if (independent) nextAddresses(addresses, input);
+         }
+ 
+         uint32_t current = position.lane * instance.laneLength +
+                            position.slice * instance.segmentLength + startIndex;
+         uint32_t previous = current % instance.laneLength == 0 ? current + instance.laneLength - 1
+                                                                 : current - 1;
+ 
+         for (uint32_t i = startIndex; i < instance.segmentLength; i++, current++, previous++) {
+             if (current % instance.laneLength == 1) previous = current - 1;
+ 
+             uint64_t pseudoRandom;
+             if (independent) {
+                 if (i % 128 == 0) nextAddresses(addresses, input);
+                 pseudoRandom = addresses.v[i % 128];
+             } else {
+                 pseudoRandom = instance.memory[previous].v[0];
+             }
+ 
+             uint32_t refLane = uint32_t((pseudoRandom >> 32) % instance.lanes);
+             if (position.pass == 0 && position.slice == 0) refLane = position.lane;
+             uint32_t refIndex = referenceIndex(instance, position, i, uint32_t(pseudoRandom),
+                                                refLane == position.lane);
+ 
+             fillBlock(instance.memory[previous], instance.memory[instance.laneLength * refLane + refIndex],
+                       instance.memory[current], position.pass != 0);
+         }
+     }
+ 
+     /**
+      * @brief Returns the threads that fill the extra lanes of multi-lane hashes.
+      * @details Separate from the hashing pool, so a hashing job can wait for its lanes without
+      *          occupying the workers that would run them.
+      */
+     static HashingPool& laneWorkers() {
+         static HashingPool workers;
+         return workers;
+     }
+ 
+ public:
+     /**
+      * @brief Computes an Argon2id tag.
+      * @param out The buffer that receives the tag.
+      * @param outlen The tag length in bytes (at least 4).
+      * @param password The password.
+      * @param salt The salt.
+      * @param saltlen The salt length in bytes.
+      * @param passes The number of passes (t), at least 1.
+      * @param memoryKiB The memory cost (m) in KiB.
+      * @param lanes The degree of parallelism (p), at least 1.
+      * @param secret Optional secret key (K).
+      * @param data Optional associated data (X).
+      */
+     static void hash(unsigned char* out, size_t outlen, const string& password,
+                      const unsigned char* salt, size_t saltlen, uint32_t passes, uint32_t memoryKiB,
+                      uint32_t lanes, const string& secret = "", const string& data = "") {
+         if (passes < 1 || lanes < 1 || outlen < 4) throw invalid_argument("Invalid Argon2 parameters");
+ 
+         // H0 binds every parameter and input
+         unsigned char h0[72], word[4];
+         crypto_generichash_state state;
+         crypto_generichash_init(&state, nullptr, 0, 64);
+         for (uint32_t value : { lanes, uint32_t(outlen), memoryKiB, passes, version, typeId }) {
+             store32(word, value);
+             crypto_generichash_update(&state, word, sizeof word);
+         }
+         updateWithLength(state, reinterpret_cast<const unsigned char*>(password.data()), password.size());
+         updateWithLength(state, salt, saltlen);
+         updateWithLength(state, reinterpret_cast<const unsigned char*>(secret.data()), secret.size());
+         updateWithLength(state, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+         crypto_generichash_final(&state, h0, 64);
+ 
+         Instance instance;
+         uint32_t blocks = max(memoryKiB, 2 * syncPoints * lanes);
+         instance.segmentLength = blocks / (lanes * syncPoints);
+         instance.memoryBlocks = instance.segmentLength * lanes * syncPoints;
+         instance.laneLength = instance.segmentLength * syncPoints;
+         instance.passes = passes;
+         instance.lanes = lanes;
+         // Every block is written before it is read, so neither buffer needs clearing
+         vector<Block> owned;
+         Arena arena;
+         if (reuseArenas) {
+             arena = arenas().take(instance.memoryBlocks, memoryKiB);
+             instance.memory = arena.get();
+         } else {
+             owned.resize(instance.memoryBlocks);
+             instance.memory = owned.data();
+         }
+         Block* memory = instance.memory;
+ 
+         // The first two blocks of every lane
+         unsigned char bytes[sizeof(Block)];
+         for (uint32_t lane = 0; lane < lanes; lane++) {
+             for (uint32_t i = 0; i < 2; i++) {
+                 store32(h0 + 64, i);
+                 store32(h0 + 68, lane);
+                 blake2bLong(bytes, sizeof bytes, h0, sizeof h0);
+                 memcpy(&memory[lane * instance.laneLength + i], bytes, sizeof bytes);
+             }
+         }
+ 
+         // Lanes of the same slice are independent; lane 0 runs on the calling thread
+         for (uint32_t pass = 0; pass < passes; pass++) {
+             for (uint32_t slice = 0; slice < syncPoints; slice++) {
+                 vector<future<void>> others;
+                 for (uint32_t lane = 1; lane < lanes; lane++)
+                     others.push_back(laneWorkers().submit([&instance, pass, lane, slice] {
+                         fillSegment(instance, { pass, lane, slice });
+                     }));
+                 fillSegment(instance, { pass, 0, slice });
+                 for (auto& lane : others) lane.get();
+             }
+         }
+ 
+         // XOR the last block of every lane and hash it into the tag
+         Block final = memory[instance.laneLength - 1];
+         for (uint32_t lane = 1; lane < lanes; lane++)
+             for (int i = 0; i < 128; i++)
+                 final.v[i] ^= memory[lane * instance.laneLength + instance.laneLength - 1].v[i];
+         memcpy(bytes, &final, sizeof bytes);
+         blake2bLong(out, outlen, bytes, sizeof bytes);
+         sodium_memzero(memory, size_t(instance.memoryBlocks) * sizeof(Block));
+         sodium_memzero(h0, sizeof h0);
+     }
+ 
+     /**
+      * @brief Enables or disables hashing in pooled arenas; disabling frees the idle ones.
+      * @details Nothing is pooled until setArenaLimits() gives the pool a capacity.
+      * @param enabled true to reuse pre-faulted arenas.
+      */
+     static void setArenaReuse(bool enabled) {
+         reuseArenas = enabled;
+         if (!enabled) arenas().clear();
+     }
+ 
+     /**
+      * @brief Checks if hashes run in pooled arenas.
+      * @return true in arena mode, false otherwise.
+      */
+     static bool arenaReuse() { return reuseArenas; }
+ 
+     /**
+      * @brief Bounds the memory kept in arenas.
+      * @param capacityBytes Most memory held by arenas, idle or in use; the admission budget.
+      * @param largestBytes Largest arena kept after a hash; the configured memory cost.
+      */
+     static void setArenaLimits(uint64_t capacityBytes, uint64_t largestBytes) {
+         arenas().setLimits(capacityBytes / sizeof(Block), largestBytes / sizeof(Block));
+     }
+ 
+     /**
+      * @brief Returns the memory currently held by arenas.
+      * @return The bytes in idle and lent arenas.
+      */
+     static uint64_t arenaBytes() { return uint64_t(arenas().residentBlocks()) * sizeof(Block); }
+ 
+     /**
+      * @brief Returns the compression kernels this CPU can run.
+      * @return The supported kernels, slowest first.
+      */
+     static vector<Kernel> supportedKernels() {
+         vector<Kernel> kernels = { Kernel::Portable };
+ #ifdef AUTH_X86_KERNELS
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("avx2")) kernels.push_back(Kernel::Avx2);
+         if (__builtin_cpu_supports("avx512f")) kernels.push_back(Kernel::Avx512);
+ #endif
+         return kernels;
+     }
+ 
+     /**
+      * @brief Selects the compression kernel; only for start-up, benchmarks and self-tests.
+      * @param selected The kernel to use; it must be in supportedKernels().
+      */
+     static void setKernel(Kernel selected) { kernel = selected; }
+ 
+     /**
+      * @brief Returns the compression kernel in use.
+      * @return The active kernel.
+      */
+     static Kernel activeKernel() { return kernel; }
+ 
+     /**
+      * @brief Returns the name of a kernel.
+      * @param which The kernel.
+      * @return "portable", "avx2" or "avx512".
+      */
+     static string kernelName(Kernel which) {
+         switch (which) {
+             case Kernel::Avx2: return "avx2";
+             case Kernel::Avx512: return "avx512";
+             default: return "portable";
+         }
+     }
+ 
+     /**
+      * @brief Checks every supported kernel against the RFC 9106 test vector and libsodium.
+      * @return true if all kernels produce the expected tags, false otherwise.
+      */
+     static bool selfTest() {
+         static const unsigned char expected[32] = {
+             0x0d, 0x64, 0x0d, 0xf5, 0x8d, 0x78, 0x76, 0x6c, 0x08, 0xc0, 0x37, 0xa3, 0x4a, 0x8b, 0x53, 0xc9,
+             0xd0, 0x1e, 0xf0, 0x45, 0x2d, 0x75, 0xb6, 0x5e, 0xb5, 0x25, 0x20, 0xe9, 0x6b, 0x01, 0xe6, 0x59 };
+         unsigned char salt[16], tag[32], reference[32];
+         memset(salt, 0x02, sizeof salt);
+         crypto_pwhash(reference, sizeof reference, "self-test", 9, salt, 2, 256 * 1024,
+                       crypto_pwhash_ALG_ARGON2ID13);
+ 
+         Kernel previous = kernel;
+         bool passed = true;
+         for (Kernel candidate : supportedKernels()) {
+             kernel = candidate;
+             hash(tag, sizeof tag, string(32, '\x01'), salt, sizeof salt, 3, 32, 4,
+                  string(8, '\x03'), string(12, '\x04'));
+             bool ok = memcmp(tag, expected, sizeof tag) == 0;
+             hash(tag, sizeof tag, "self-test", salt, sizeof salt, 2, 256, 1);
+             ok = ok && memcmp(tag, reference, sizeof tag) == 0;
+             cout << "  " << kernelName(candidate) << ": " << (ok ? "ok" : "FAILED") << endl;
+             passed = passed && ok;
+         }
+         kernel = previous;
+         return passed;
+     }
+ 
+     /**
+      * @brief Encodes a hash in the same "$argon2id$v=19$m=...,t=...,p=...$salt$hash" format as crypto_pwhash_str.
+      * @return The encoded hash.
+      */
+     static string encode(uint32_t memoryKiB, uint32_t passes, uint32_t lanes,
+                          const unsigned char* salt, size_t saltlen, const unsigned char* tag, size_t taglen) {
+         const int variant = sodium_base64_VARIANT_ORIGINAL_NO_PADDING;
+         vector<char> saltText(sodium_base64_ENCODED_LEN(saltlen, variant));
+         vector<char> tagText(sodium_base64_ENCODED_LEN(taglen, variant));
+         sodium_bin2base64(saltText.data(), saltText.size(), salt, saltlen, variant);
+         sodium_bin2base64(tagText.data(), tagText.size(), tag, taglen, variant);
+         return "$argon2id$v=19$m=" + to_string(memoryKiB) + ",t=" + to_string(passes) +
+                ",p=" + to_string(lanes) + "$" + saltText.data() + "$" + tagText.data();
+     }
+ 
+     /**
+      * @brief Parses an encoded Argon2id hash.
+      * @return true if the string is a valid Argon2id v1.3 encoded hash, false otherwise.
+      */
+     static bool decode(const string& encoded, uint32_t& memoryKiB, uint32_t& passes, uint32_t& lanes,
+                        vector<unsigned char>& salt, vector<unsigned char>& tag) {
+         unsigned int m, t, p;
+         int consumed = 0;
+         if (sscanf(encoded.c_str(), "$argon2id$v=19$m=%u,t=%u,p=%u$%n", &m, &t, &p, &consumed) != 3 || !consumed)
+             return false;
+         size_t split = encoded.find('$', consumed);
+         if (split == string::npos) return false;
+ 
+         const int variant = sodium_base64_VARIANT_ORIGINAL_NO_PADDING;
+         size_t length;
+         salt.resize(encoded.size());
+         tag.resize(encoded.size());
+         if (sodium_base642bin(salt.data(), salt.size(), encoded.c_str() + consumed, split - consumed,
+                               nullptr, &length, nullptr, variant) != 0) return false;
+         salt.resize(length);
+         if (sodium_base642bin(tag.data(), tag.size(), encoded.c_str() + split + 1, encoded.size() - split - 1,
+                               nullptr, &length, nullptr, variant) != 0) return false;
+         tag.resize(length);
+         memoryKiB = m;
+         passes = t;
+         lanes = p;
+         return p >= 1 && t >= 1 && !salt.empty() && tag.size() >= 4;
+     }
+ };
+ 
+ atomic<bool> Argon2::reuseArenas(false);  ///< Static member variable set in arena mode
+ 
+ /**
+  * @brief Gives a pooled arena back to the pool, or frees a one-off buffer.
+  * @param memory The arena.
+  */
+ void Argon2::ArenaReturn::operator()(Block* memory) const {
+     if (pooled) arenas().giveBack(memory, blocks);
+     else delete[] memory;
+ }
+ Argon2::Kernel Argon2::kernel = Argon2::detectKernel();  ///< Static member variable for the compression kernel
+ 
+ /**
+  * @class HexCodec
+  * @brief Converts between bytes and lowercase hex, 16 or 32 bytes per step with SSSE3 or AVX2.
+  * @details Legacy records store the hash and salt as hex text. The vector kernels look digits
+  *          up with in-register shuffles and validate with compares, so their timing never
+  *          depends on the data. The bytes left over at the end go through a scalar routine:
+  *          a table lookup in Fast mode, or branch-free arithmetic in ConstantTime mode, which
+  *          is what callers handling password hashes ask for.
+  */
+ class HexCodec {
+ public:
+     /**
+      * @brief How the scalar routine handles the bytes the vector kernel leaves over.
+      */
+     enum class Mode { Fast, ConstantTime };
+ 
+     /**
+      * @brief Implementations of the bulk conversion.
+      */
+     enum class Kernel { Scalar, Ssse3, Avx2 };
+ 
+ private:
+     static Kernel kernel;  ///< The bulk kernel in use
+     static const char digits[17];  ///< Lowercase hex digits
+ 
+     /**
+      * @brief Returns the value of a hex digit, or -1, without branching on the digit.
+      */
+     static int digitValueConstantTime(unsigned char c) {
+         int digit = int(c) - '0';
+         int alpha = int(c | 0x20) - 'a';
+         int isDigit = ((digit | (9 - digit)) >> 8) + 1;  // 1 if 0 <= digit <= 9, 0 otherwise
+         int isAlpha = ((alpha | (5 - alpha)) >> 8) + 1;
+         return (digit & -isDigit) | ((alpha + 10) & -isAlpha) | ((isDigit | isAlpha) - 1);
+     }
+ 
+     /**
+      * @brief Returns the value of a hex digit, or -1, with a table lookup.
+      */
+     static int digitValueFast(unsigned char c) {
+         static const auto table = [] {
+             array<signed char, 256> values;
+             values.fill(-1);
+             for (int i = 0; i < 10; i++) values['0' + i] = i;
+             for (int i = 0; i < 6; i++) values['a' + i] = values['A' + i] = 10 + i;
+             return values;
+         }();
+         return table[c];
+     }
+ 
+     /**
+      * @brief Encodes bytes one at a time.
+      */
+     static void encodeScalar(const unsigned char* in, size_t length, char* out, Mode mode) {
+         for (size_t i = 0; i < length; i++) {
+             unsigned high = in[i] >> 4, low = in[i] & 15;
+             if (mode == Mode::Fast) {
+                 out[2 * i] = digits[high];
+                 out[2 * i + 1] = digits[low];
+             } else {  // 'a' - '0' - 10 = 39 is added only when the nibble is above 9
+                 out[2 * i] = char('0' + high + ((9 - int(high)) >> 8 & 39));
+                 out[2 * i + 1] = char('0' + low + ((9 - int(low)) >> 8 & 39));
+             }
+         }
+     }
+ 
+     /**
+      * @brief Decodes digit pairs one at a time.
+      * @return true if every character is a hex digit, false otherwise.
+      */
+     static bool decodeScalar(const char* in, size_t bytes, unsigned char* out, Mode mode) {
+         int invalid = 0;
+         for (size_t i = 0; i < bytes; i++) {
+             unsigned char a = in[2 * i], b = in[2 * i + 1];
+             int high = mode == Mode::Fast ? digitValueFast(a) : digitValueConstantTime(a);
+             int low = mode == Mode::Fast ? digitValueFast(b) : digitValueConstantTime(b);
+             if (mode == Mode::Fast && (high | low) < 0) return false;
+             invalid |= high | low;  // Negative if either digit was invalid
+             out[i] = (unsigned char)(((high & 15) << 4) | (low & 15));
+         }
+         return invalid >= 0;
+     }
+ 
+ #ifdef AUTH_X86_KERNELS
+     /**
+      * @brief Encodes 16 bytes per step; returns the number of bytes done.
+      */
+     __attribute__((target("ssse3")))
+     static size_t encodeSsse3(const unsigned char* in, size_t length, char* out) {
+         const __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(digits));
+         const __m128i nibble = _mm_set1_epi8(15);
+         size_t i = 0;
+         for (; i + 16 <= length; i += 16) {
+             __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+             __m128i high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+             __m128i low = _mm_shuffle_epi8(table, _mm_and_si128(x, nibble));
+             _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+             _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+         }
+         return i;
+     }
+ 
+     /**
+      * @brief Converts 16 hex digits to their values; 'valid' is cleared if any is not a digit.
+      */
+     __attribute__((target("ssse3")))
+     static __m128i digitValues128(__m128i c, __m128i& valid) {
+         __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+         __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+         __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+         __m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+         valid = _mm_and_si128(valid, _mm_or_si128(isDigit, isAlpha));
+         return _mm_or_si128(_mm_and_si128(isDigit, digit),
+                             _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+     }
+ 
+     /**
+      * @brief Decodes 32 digits per step; returns the number of bytes done, or -1 on a bad digit.
+      */
+     __attribute__((target("ssse3")))
+     static long decodeSsse3(const char* in, size_t bytes, unsigned char* out) {
+         const __m128i weights = _mm_set1_epi16(0x0110);  // High digit * 16 + low digit
+         __m128i valid = _mm_set1_epi8(-1);
+         size_t i = 0;
+         for (; i + 16 <= bytes; i += 16) {
+             __m128i first = digitValues128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), valid);
+             __m128i second = digitValues128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16)), valid);
+             __m128i packed = _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights));
+             _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+         }
+         return _mm_movemask_epi8(valid) == 0xFFFF ? long(i) : -1;
+     }
+ 
+     /**
+      * @brief Encodes 16 bytes per step into 32 digits with one shuffle; returns the bytes done.
+      */
+     __attribute__((target("avx2")))
+     static size_t encodeAvx2(const unsigned char* in, size_t length, char* out) {
+         const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(digits)));
+         size_t i = 0;
+         for (; i + 16 <= length; i += 16) {
+             // One byte per 16-bit word: the high nibble goes to the first digit, the low one to the second
+             __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+             __m256i pairs = _mm256_or_si256(_mm256_srli_epi16(x, 4),
+                                             _mm256_slli_epi16(_mm256_and_si256(x, _mm256_set1_epi16(15)), 8));
+             _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_shuffle_epi8(table, pairs));
+         }
+         return i;
+     }
+ 
+     /**
+      * @brief Converts 32 hex digits to their values; 'valid' is cleared if any is not a digit.
+      */
+     __attribute__((target("avx2")))
+     static __m256i digitValues256(__m256i c, __m256i& valid) {
+         __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+         __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+         __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+         __m256i isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+         valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isAlpha));
+         return _mm256_or_si256(_mm256_and_si256(isDigit, digit),
+                                _mm256_and_si256(isAlpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+     }
+ 
+     /**
+      * @brief Decodes 64 digits per step; returns the number of bytes done, or -1 on a bad digit.
+      */
+     __attribute__((target("avx2")))
+     static long decodeAvx2(const char* in, size_t bytes, unsigned char* out) {
+         const __m256i weights = _mm256_set1_epi16(0x0110);
+         __m256i valid = _mm256_set1_epi8(-1);
+         size_t i = 0;
+         for (; i + 32 <= bytes; i += 32) {
+             __m256i first = digitValues256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i)), valid);
+             __m256i second = digitValues256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i + 32)), valid);
+             __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights),
+                                                  _mm256_maddubs_epi16(second, weights));
+             packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));  // packus works per 128-bit lane
+             _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+         }
+         if (_mm256_movemask_epi8(valid) != -1) return -1;
+         long tail = decodeSsse3(in + 2 * i, bytes - i, out + i);  // One 16-byte step may remain
+         return tail < 0 ? -1 : long(i) + tail;
+     }
+ #endif
+ 
+     /**
+      * @brief Returns the fastest kernel the CPU supports.
+      */
+     static Kernel detectKernel() {
+ #ifdef AUTH_X86_KERNELS
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("avx2")) return Kernel::Avx2;
+         if (__builtin_cpu_supports("ssse3")) return Kernel::Ssse3;
+ #endif
+         return Kernel::Scalar;
+     }
+ 
+ public:
+     /**
+      * @brief Encodes bytes as lowercase hex.
+      * @param in The bytes to encode.
+      * @param length The number of bytes.
+      * @param out Receives 2 * length characters; no terminator is written.
+      * @param mode How the bytes after the last full vector are encoded.
+      */
+     static void encode(const unsigned char* in, size_t length, char* out, Mode mode = Mode::Fast) {
+         size_t done = 0;
+ #ifdef AUTH_X86_KERNELS
+         if (kernel == Kernel::Avx2) done = encodeAvx2(in, length, out);
+         else if (kernel == Kernel::Ssse3) done = encodeSsse3(in, length, out);
+ #endif
+         encodeScalar(in + done, length - done, out + 2 * done, mode);
+     }
+ 
+     /**
+      * @brief Encodes bytes as a lowercase hex string.
+      * @param in The bytes to encode.
+      * @param length The number of bytes.
+      * @param mode How the bytes after the last full vector are encoded.
+      * @return The hex string.
+      */
+     static string encode(const unsigned char* in, size_t length, Mode mode = Mode::Fast) {
+         string hex(2 * length, '\0');
+         encode(in, length, &hex[0], mode);
+         return hex;
+     }
+ 
+     /**
+      * @brief Decodes hex, upper or lower case, into bytes.
+      * @param in The hex digits.
+      * @param length The number of digits; must be even.
+      * @param out Receives length / 2 bytes.
+      * @param mode How the digits after the last full vector are decoded; ConstantTime also
+      *             checks every digit before reporting an error.
+      * @return true if every character is a hex digit, false otherwise.
+      */
+     static bool decode(const char* in, size_t length, unsigned char* out, Mode mode = Mode::Fast) {
+         if (length % 2) return false;
+         size_t bytes = length / 2;
+         long done = 0;
+ #ifdef AUTH_X86_KERNELS
+         if (kernel == Kernel::Avx2) done = decodeAvx2(in, bytes, out);
+         else if (kernel == Kernel::Ssse3) done = decodeSsse3(in, bytes, out);
+ #endif
+         if (done < 0) {
+             if (mode == Mode::Fast) return false;
+             decodeScalar(in, bytes, out, mode);  // Same work as a valid input
+             return false;
+         }
+         return decodeScalar(in + 2 * done, bytes - done, out + done, mode);
+     }
+ 
+     /**
+      * @brief Returns the bulk kernels this CPU can run.
+      * @return The supported kernels, slowest first.
+      */
+     static vector<Kernel> supportedKernels() {
+         vector<Kernel> kernels = { Kernel::Scalar };
+ #ifdef AUTH_X86_KERNELS
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("ssse3")) kernels.push_back(Kernel::Ssse3);
+         if (__builtin_cpu_supports("avx2")) kernels.push_back(Kernel::Avx2);
+ #endif
+         return kernels;
+     }
+ 
+     /**
+      * @brief Selects the bulk kernel; only for start-up and benchmarks.
+      * @param selected The kernel to use; it must be in supportedKernels().
+      */
+     static void setKernel(Kernel selected) { kernel = selected; }
+ 
+     /**
+      * @brief Returns the bulk kernel in use.
+      * @return The active kernel.
+      */
+     static Kernel activeKernel() { return kernel; }
+ 
+     /**
+      * @brief Returns the name of a kernel.
+      * @param which The kernel.
+      * @return "scalar", "ssse3" or "avx2".
+      */
+     static string kernelName(Kernel which) {
+         switch (which) {
+             case Kernel::Ssse3: return "ssse3";
+             case Kernel::Avx2: return "avx2";
+             default: return "scalar";
+         }
+     }
+ };
+ 
+ HexCodec::Kernel HexCodec::kernel = HexCodec::detectKernel();  ///< Static member variable for the hex kernel
+ const char HexCodec::digits[17] = "0123456789abcdef";  ///< Static constant string of the hex digits
+ 
+ /**
+  * @class Credential
+  * @brief A stored password hash held as raw bytes: the Argon2id cost, the salt and the tag.
+  * @details users.txt keeps credentials as text, either as an encoded hash or, for older
+  *          records, as hex. parse() converts the text once when a record is read and
+  *          hashText() / saltText() convert back when one is written; lookups, caching and
+  *          the final comparison all work on the bytes.
+  */
+ class Credential {
+ public:
+     /**
+      * @brief The text form a credential is read from and written back in.
+      */
+     enum class Format {
+         Encoded,  ///< "$argon2id$v=19$m=...,t=...,p=...$salt$tag" with an empty salt field
+         LegacyCost,  ///< "opslimit:memlimit:hex" with a hex salt
+         LegacyHex  ///< A hex hash made with MODERATE and a hex salt
+     };
+ 
+     static const size_t maxBytes = 64;  ///< Largest salt or tag that can be stored
+ 
+     Format format = Format::Encoded;  ///< The text form of the record
+     unsigned long long passes = 0;  ///< Argon2 passes
+     size_t memlimit = 0;  ///< Argon2 memory in bytes
+     uint32_t lanes = 1;  ///< Argon2 lanes
+     size_t saltLength = 0;  ///< Bytes used in 'salt'
+     size_t tagLength = 0;  ///< Bytes used in 'tag'
+     unsigned char salt[maxBytes] = {};  ///< The salt
+     unsigned char tag[maxBytes] = {};  ///< The expected Argon2 output
+ 
+ private:
+     /**
+      * @brief Decodes a hex string into at most maxBytes bytes, in constant time.
+      * @return true if the whole string is valid hex, false otherwise.
+      */
+     static bool fromHex(const string& hex, unsigned char* out, size_t& length) {
+         length = hex.size() / 2;
+         if (hex.empty() || length > maxBytes) return false;
+         return HexCodec::decode(hex.data(), hex.size(), out, HexCodec::Mode::ConstantTime);
+     }
+ 
+     /**
+      * @brief Encodes bytes as lowercase hex, in constant time.
+      */
+     static string toHex(const unsigned char* bytes, size_t length) {
+         return HexCodec::encode(bytes, length, HexCodec::Mode::ConstantTime);
+     }
+ 
+ public:
+     /**
+      * @brief Parses the hash and salt fields of a stored record.
+      * @param hash The stored hash: encoded, "opslimit:memlimit:hex" or plain hex.
+      * @param salt The stored hex salt; empty for encoded hashes.
+      * @param out Receives the credential.
+      * @return true if the fields describe a valid credential, false otherwise.
+      */
+     static bool parse(const string& hash, const string& salt, Credential& out) {
+         out = Credential();
+         try {
+             if (!hash.empty() && hash[0] == '$') {
+                 uint32_t m, t, p;
+                 vector<unsigned char> saltBytes, tagBytes;
+                 if (!Argon2::decode(hash, m, t, p, saltBytes, tagBytes)) return false;
+                 if (saltBytes.size() > maxBytes || tagBytes.size() > maxBytes) return false;
+                 out.format = Format::Encoded;
+                 out.passes = t;
+                 out.memlimit = size_t(m) * 1024;
+                 out.lanes = p;
+                 out.saltLength = saltBytes.size();
+                 out.tagLength = tagBytes.size();
+                 memcpy(out.salt, saltBytes.data(), out.saltLength);
+                 memcpy(out.tag, tagBytes.data(), out.tagLength);
+                 return true;
+             }
+ 
+             out.format = Format::LegacyHex;
+             out.passes = crypto_pwhash_OPSLIMIT_MODERATE;
+             out.memlimit = crypto_pwhash_MEMLIMIT_MODERATE;
+             string tagHex = hash;
+             size_t pos1 = hash.find(':'), pos2 = hash.find(':', pos1 + 1);
+             if (pos1 != string::npos && pos2 != string::npos) {
+                 out.format = Format::LegacyCost;
+                 out.passes = stoull(hash.substr(0, pos1));
+                 out.memlimit = stoull(hash.substr(pos1 + 1, pos2 - pos1 - 1));
+                 tagHex = hash.substr(pos2 + 1);
+             }
+             return fromHex(tagHex, out.tag, out.tagLength) && fromHex(salt, out.salt, out.saltLength);
+         } catch (...) {
+             return false;  // Malformed cost
+         }
+     }
+ 
+     /**
+      * @brief Returns the text stored in the hash field of the record.
+      * @return The encoded hash, or the hex hash for legacy records.
+      */
+     string hashText() const {
+         switch (format) {
+             case Format::LegacyCost:
+                 return to_string(passes) + ":" + to_string(memlimit) + ":" + toHex(tag, tagLength);
+             case Format::LegacyHex:
+                 return toHex(tag, tagLength);
+             default:
+                 return Argon2::encode(memlimit / 1024, passes, lanes, salt, saltLength, tag, tagLength);
+         }
+     }
+ 
+     /**
+      * @brief Returns the text stored in the salt field of the record.
+      * @return The hex salt, or an empty string for encoded hashes.
+      */
+     string saltText() const { return format == Format::Encoded ? "" : toHex(salt, saltLength); }
+ };
+ 
+ /**
+  * @class SingleFlight
+  * @brief Lets identical verifications that overlap in time share one computation.
+  * @details The first caller for a key becomes the leader and runs the work; callers that
+  *          arrive with the same key before it finishes only queue a promise and receive the
+  *          leader's result. Once the result is published the key is forgotten, so later
+  *          attempts start a new flight. If the work fails, every waiter gets its exception.
+  */
+ class SingleFlight {
+ public:
+     /**
+      * @brief Counters describing how often work was shared.
+      */
+     struct Stats {
+         uint64_t leaders = 0;  ///< Calls that ran the work
+         uint64_t followers = 0;  ///< Calls that reused a running flight
+     };
+ 
+ private:
+     /**
+      * @brief A caller waiting for a flight to land.
+      */
+     struct Waiter {
+         promise<bool> result;  ///< Fulfilled with the shared result
+         function<void(bool, exception_ptr)> onComplete;  ///< Optional callback run before the promise is set
+     };
+ 
+     mutex lock;  ///< Protects the members below
+     unordered_map<string, vector<Waiter>> flights;  ///< Waiters of each running flight
+     Stats stats;  ///< Sharing counters
+ 
+ public:
+     /**
+      * @brief Joins the flight for a key, starting it if none is running.
+      * @param key Identifies the work; equal keys must mean equal results.
+      * @param onComplete Optional callback run with the result, or with the work's exception.
+      * @param leader Set to true if the caller must run the work and call land().
+      * @return A future that becomes ready with the shared result or exception.
+      */
+     future<bool> join(const string& key, function<void(bool, exception_ptr)> onComplete, bool& leader) {
+         Waiter waiter{promise<bool>(), move(onComplete)};
+         future<bool> result = waiter.result.get_future();
+         lock_guard<mutex> guard(lock);
+         auto it = flights.find(key);
+         leader = it == flights.end();
+         if (leader) {
+             flights[key].push_back(move(waiter));
+             stats.leaders++;
+         } else {
+             it->second.push_back(move(waiter));
+             stats.followers++;
+         }
+         return result;
+     }
+ 
+     /**
+      * @brief Publishes the result of a flight to all of its waiters.
+      * @param key The key passed to join().
+      * @param result The result of the work.
+      * @param error The exception thrown by the work instead, if any.
+      */
+     void land(const string& key, bool result, exception_ptr error = nullptr) {
+         vector<Waiter> waiters;
+         {
+             lock_guard<mutex> guard(lock);
+             auto it = flights.find(key);
+             if (it == flights.end()) return;
+             waiters = move(it->second);
+             flights.erase(it);
+         }
+         for (Waiter& waiter : waiters) {
+             if (waiter.onComplete) waiter.onComplete(result, error);
+             if (error) waiter.result.set_exception(error);
+             else waiter.result.set_value(result);
+         }
+     }
+ 
+     /**
+      * @brief Returns the sharing counters.
+      * @return The number of leaders and followers so far.
+      */
+     Stats snapshot() {
+         lock_guard<mutex> guard(lock);
+         return stats;
+     }
+ };
+ 
+ /**
+  * @class VerifiedCache
+  * @brief Remembers recent successful verifications for a short time, so repeat logins skip Argon2.
+  * @details Off unless a TTL is set. Each entry is keyed by the stored credential and holds a
+  *          keyed BLAKE2b MAC of the password that matched it, never the password itself; the
+  *          MAC key is random and never leaves the process. A repeat login within the TTL
+  *          recomputes the MAC and compares it in constant time. A changed record has a new
+  *          salt and tag, so its old entry can no longer match. Entries are dropped oldest
+  *          first, which with one TTL for all is also the order they expire in; when the cache
+  *          is full, the oldest entry makes room even if it has not expired yet.
+  */
+ class VerifiedCache {
+ public:
+     /**
+      * @brief Counters describing the cache.
+      */
+     struct Stats {
+         uint64_t hits = 0;  ///< Verifications answered without Argon2
+         uint64_t misses = 0;  ///< Verifications that had to hash
+         size_t entries = 0;  ///< Entries currently stored, including expired ones
+     };
+ 
+ private:
+     /**
+      * @brief A recent successful verification.
+      */
+     struct Entry {
+         string mac;  ///< Keyed MAC of the password and credential
+         chrono::steady_clock::time_point expires;  ///< When the entry stops counting
+         list<string>::iterator position;  ///< The entry's place in 'order'
+     };
+ 
+     static const size_t maxEntries = 100000;  ///< Entries kept at most
+     mutex lock;  ///< Protects the members below
+     unordered_map<string, Entry> entries;  ///< Credential salt and tag to entry
+     list<string> order;  ///< Ids of the entries, oldest first
+     chrono::milliseconds ttl{0};  ///< How long a success is remembered; 0 disables the cache
+     Stats stats;  ///< Cache counters
+ 
+     /**
+      * @brief Checks for an unexpired entry with the given MAC; the caller holds 'lock'.
+      */
+     bool matches(const string& id, const string& mac) const {
+         auto it = entries.find(id);
+         return it != entries.end() && it->second.expires > chrono::steady_clock::now() &&
+                it->second.mac.size() == mac.size() &&
+                sodium_memcmp(it->second.mac.data(), mac.data(), mac.size()) == 0;
+     }
+ 
+ public:
+     /**
+      * @brief Sets how long successful verifications are remembered.
+      * @param duration The TTL; 0 disables the cache and forgets every entry.
+      */
+     void setTtl(chrono::milliseconds duration) {
+         lock_guard<mutex> guard(lock);
+         ttl = duration;
+         if (ttl.count() == 0) {
+             entries.clear();
+             order.clear();
+         }
+     }
+ 
+     /**
+      * @brief Checks if the cache is on.
+      * @return true if a TTL is set, false otherwise.
+      */
+     bool enabled() {
+         lock_guard<mutex> guard(lock);
+         return ttl.count() > 0;
+     }
+ 
+     /**
+      * @brief Checks if a credential was recently verified with the same password.
+      * @param id The credential's salt and tag.
+      * @param mac The MAC of the password being verified.
+      * @return true on an unexpired match, false otherwise.
+      */
+     bool check(const string& id, const string& mac) {
+         lock_guard<mutex> guard(lock);
+         bool hit = matches(id, mac);
+         hit ? stats.hits++ : stats.misses++;
+         return hit;
+     }
+ 
+     /**
+      * @brief Same as check(), without counting a hit or a miss.
+      * @param id The credential's salt and tag.
+      * @param mac The MAC of the password being verified.
+      * @return true on an unexpired match, false otherwise.
+      */
+     bool peek(const string& id, const string& mac) {
+         lock_guard<mutex> guard(lock);
+         return matches(id, mac);
+     }
+ 
+     /**
+      * @brief Records a successful verification.
+      * @details Drops the expired entries at the old end, and the oldest one if the cache is
+      *          still full, so each call does constant work on average.
+      * @param id The credential's salt and tag.
+      * @param mac The MAC of the password that matched.
+      */
+     void remember(const string& id, const string& mac) {
+         lock_guard<mutex> guard(lock);
+         if (ttl.count() == 0) return;
+         auto now = chrono::steady_clock::now();
+         auto existing = entries.find(id);
+         if (existing != entries.end()) {
+             order.erase(existing->second.position);
+             entries.erase(existing);
+         }
+         while (!order.empty()) {
+             auto oldest = entries.find(order.front());
+             if (entries.size() < maxEntries && oldest->second.expires > now) break;
+             entries.erase(oldest);
+             order.pop_front();
+         }
+         order.push_back(id);
+         entries[id] = {mac, now + ttl, prev(order.end())};
+     }
+ 
+     /**
+      * @brief Returns the cache counters.
+      * @return The hit and miss counters and the number of entries.
+      */
+     Stats snapshot() {
+         lock_guard<mutex> guard(lock);
+         stats.entries = entries.size();
+         return stats;
+     }
+ };
+ 
+ /**
+  * @class LoginRateLimiter
+  * @brief Token buckets that cap password attempts per username and in total, before any hashing.
+  * @details Every attempt takes one token from its username's bucket and one from a global
+  *          bucket; buckets refill continuously up to their burst size. A rejected attempt
+  *          costs a hash-map lookup instead of an Argon2 hash, so a brute-force burst cannot
+  *          occupy every core. Username buckets are spread over independently locked shards;
+  *          when a shard is full, buckets that have refilled completely are dropped, at most
+  *          once a second, and attempts on usernames that find no room are only charged to the
+  *          global bucket.
+  */
+ class LoginRateLimiter {
+ public:
+     /**
+      * @brief Counters describing the limiter.
+      */
+     struct Stats {
+         uint64_t allowed = 0;  ///< Attempts let through
+         uint64_t rejectedUser = 0;  ///< Attempts refused by their username's bucket
+         uint64_t rejectedGlobal = 0;  ///< Attempts refused by the global bucket
+     };
+ 
+ private:
+     /**
+      * @brief A token bucket; 'tokens' is brought up to date lazily when the bucket is used.
+      */
+     struct Bucket {
+         double tokens = 0;  ///< Tokens available at 'updated'
+         chrono::steady_clock::time_point updated;  ///< Last refill time
+     };
+ 
+     /**
+      * @brief A group of username buckets behind one lock.
+      */
+     struct alignas(64) Shard {
+         mutex lock;  ///< Protects the members below
+         unordered_map<string, Bucket> buckets;  ///< Username to bucket
+         chrono::steady_clock::time_point pruned;  ///< Last time full buckets were dropped
+     };
+ 
+     static const size_t shardCount = 64;  ///< Number of shards, a power of two
+     static const size_t shardLimit = 4096;  ///< Buckets per shard; at this size full buckets are dropped
+     Shard shards[shardCount];  ///< Username buckets
+     mutex globalLock;  ///< Protects 'global' and its rate
+     Bucket global;  ///< Shared by all attempts
+     atomic<double> userRate;  ///< Tokens per second added to each username bucket; read without a lock
+     atomic<double> userBurst;  ///< Capacity of each username bucket; read without a lock
+     double globalRate;  ///< Tokens per second added to the global bucket
+     double globalBurst;  ///< Capacity of the global bucket
+     atomic<uint64_t> allowed, rejectedUser, rejectedGlobal;  ///< Counters
+ 
+     /**
+      * @brief Adds the tokens earned since the last update, up to the burst size.
+      */
+     static void refill(Bucket& bucket, double rate, double burst, chrono::steady_clock::time_point now) {
+         double elapsed = chrono::duration<double>(now - bucket.updated).count();
+         bucket.tokens = min(burst, bucket.tokens + elapsed * rate);
+         bucket.updated = now;
+     }
+ 
+ public:
+     /**
+      * @brief Constructor: sets the rates; all buckets start full.
+      * @param userPerMinute Sustained attempts allowed per username per minute.
+      * @param perUserBurst Attempts a username may make at once.
+      * @param globalPerSecond Sustained attempts allowed per second in total.
+      * @param totalBurst Attempts allowed at once in total.
+      */
+     LoginRateLimiter(double userPerMinute, double perUserBurst, double globalPerSecond, double totalBurst)
+         : userRate(userPerMinute / 60), userBurst(perUserBurst), globalRate(globalPerSecond),
+           globalBurst(totalBurst), allowed(0), rejectedUser(0), rejectedGlobal(0) {
+         global.tokens = totalBurst;
+         global.updated = chrono::steady_clock::now();
+     }
+ 
+     /**
+      * @brief Changes the per-username rate.
+      * @param perMinute Sustained attempts per username per minute.
+      * @param burst Attempts a username may make at once.
+      */
+     void setUserRate(double perMinute, double burst) {
+         userRate = perMinute / 60;
+         userBurst = burst;
+     }
+ 
+     /**
+      * @brief Changes the global rate.
+      * @param perSecond Sustained attempts per second in total.
+      * @param burst Attempts allowed at once in total.
+      */
+     void setGlobalRate(double perSecond, double burst) {
+         lock_guard<mutex> guard(globalLock);
+         globalRate = perSecond;
+         globalBurst = burst;
+         global.tokens = min(global.tokens, burst);
+     }
+ 
+     /**
+      * @brief Takes a token for an attempt on a username if both buckets have one.
+      * @details The shard lock is held throughout; the global lock only once, to refill, check
+      *          and take from the global bucket in one step.
+      * @param username The username being tried.
+      * @return true if the attempt may be hashed, false if it must be refused.
+      */
+     bool tryAcquire(const string& username) {
+         auto now = chrono::steady_clock::now();
+         double rate = userRate.load(memory_order_relaxed), burst = userBurst.load(memory_order_relaxed);
+ 
+         Shard& shard = shards[hash<string>()(username) & (shardCount - 1)];
+         lock_guard<mutex> guard(shard.lock);
+         if (shard.buckets.size() >= shardLimit && now - shard.pruned >= chrono::seconds(1)) {
+             shard.pruned = now;
+             for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+                 refill(it->second, rate, burst, now);
+                 it = it->second.tokens >= burst ? shard.buckets.erase(it) : next(it);
+             }
+         }
+         auto found = shard.buckets.find(username);
+         Bucket* user = found == shard.buckets.end() ? nullptr : &found->second;
+         if (user) {
+             refill(*user, rate, burst, now);
+             if (user->tokens < 1) return (rejectedUser++, false);
+         }
+ 
+         {
+             lock_guard<mutex> globalGuard(globalLock);
+             refill(global, globalRate, globalBurst, now);
+             if (global.tokens < 1) return (rejectedGlobal++, false);
+             global.tokens -= 1;
+         }
+         if (!user && shard.buckets.size() < shardLimit) {  // A new bucket starts full
+             user = &shard.buckets[username];
+             user->tokens = burst;
+             user->updated = now;
+         }
+         if (user) user->tokens -= 1;
+         allowed++;
+         return true;
+     }
+ 
+     /**
+      * @brief Returns the limiter counters.
+      * @return The allowed and rejected attempt counts.
+      */
+     Stats snapshot() const {
+         Stats stats;
+         stats.allowed = allowed;
+         stats.rejectedUser = rejectedUser;
+         stats.rejectedGlobal = rejectedGlobal;
+         return stats;
+     }
+ };
+ 
+ /**
+  * @class PasswordHasher
+  * @brief Provides static methods for hashing passwords using the Libsodium library.
+  */
+ class PasswordHasher {
+ public:
+     /**
+      * @brief A password to check against a stored credential.
+      */
+     struct VerifyJob {
+         string password;  ///< The password to verify
+         Credential credential;  ///< The stored credential
+     };
+ 
+ private:
+     static chrono::milliseconds admissionTimeout;  ///< How long a hash may wait for memory
+     static unsigned long long opslimit;  ///< Argon2 passes used for new hashes
+     static size_t memlimit;  ///< Argon2 memory in bytes used for new hashes
+     static uint32_t lanes;  ///< Argon2 lanes used for new hashes; more than 1 uses the Argon2 class
+     static const string settingsFile;  ///< Where calibrate() saves the chosen cost
+ 
+     /**
+      * @brief Measures the 99th percentile latency of concurrent hashes at a given cost.
+      * @param ops The Argon2 passes.
+      * @param mem The Argon2 memory in bytes.
+      * @param concurrency The number of hashes running at the same time.
+      * @param rounds The number of hashes each thread runs.
+      * @return The p99 latency in milliseconds, or infinity if a hash failed.
+      */
+     static double measureP99(unsigned long long ops, size_t mem, unsigned concurrency, int rounds) {
+         vector<double> latencies;
+         mutex latenciesLock;
+         atomic<bool> failed(false);
+         Credential probe;
+         probe.passes = ops;
+         probe.memlimit = mem;
+         probe.lanes = lanes;  // The lane count saved with the result, so the latency matches it
+         probe.saltLength = crypto_pwhash_SALTBYTES;
+         probe.tagLength = 32;
+         salts().take(probe.salt);
+ 
+         vector<thread> threads;
+         for (unsigned t = 0; t < concurrency; t++) {
+             threads.emplace_back([&] {
+                 for (int i = 0; i < rounds; i++) {
+                     auto start = chrono::steady_clock::now();
+                     try {
+                         unsigned char tag[Credential::maxBytes];
+                         computeTag("calibration password", probe, tag);
+                     } catch (...) {
+                         failed = true;
+                         return;
+                     }
+                     double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                     lock_guard<mutex> guard(latenciesLock);
+                     latencies.push_back(ms);
+                 }
+             });
+         }
+         for (thread& t : threads) t.join();
+         if (failed || latencies.empty()) return numeric_limits<double>::infinity();
+ 
+         sort(latencies.begin(), latencies.end());
+         size_t rank = (latencies.size() * 99 + 99) / 100;  // ceil(0.99 * n)
+         return latencies[rank - 1];
+     }
+ 
+ public:
+     /**
+      * @brief Initializes the libsodium library for cryptographic operations.
+      * @details Also loads the hashing cost saved by calibrate(), if any.
+      * @return true if initialization is successful, false otherwise.
+      */
+     static bool initialize() {
+         if (sodium_init() < 0) return (Terminal::printError("Libsodium init failed"), false);
+         loadSettings();
+         return true;
+     }
+ 
+     /**
+      * @brief Loads the hashing cost from the settings file; keeps MODERATE if there is none.
+      * @details Lines whose value is not a plain number are ignored, and values are clamped to
+      *          the range libsodium accepts, so a hand-edited file cannot stop the program.
+      */
+     static void loadSettings() {
+         ifstream file(settingsFile);
+         string line;
+         while (getline(file, line)) {
+             size_t pos = line.find('=');
+             if (pos == string::npos) continue;
+             string key = line.substr(0, pos), value = line.substr(pos + 1);
+             unsigned long long number;
+             if (!parseNumber(value, number, 0ull, ~0ull)) continue;  // Damaged line: keep the current value
+ 
+             if (key == "opslimit") {
+                 opslimit = min<unsigned long long>(max<unsigned long long>(number, crypto_pwhash_OPSLIMIT_MIN),
+                                                    crypto_pwhash_OPSLIMIT_MAX);
+             } else if (key == "memlimit") {
+                 memlimit = size_t(min<unsigned long long>(max<unsigned long long>(number, crypto_pwhash_MEMLIMIT_MIN),
+                                                           crypto_pwhash_MEMLIMIT_MAX));
+             } else if (key == "lanes") {
+                 lanes = uint32_t(min<unsigned long long>(max(number, 1ull), 0xFFFFFF));  // Argon2 allows 2^24 - 1
+             }
+         }
+     }
+ 
+     /**
+      * @brief Finds the highest Argon2 cost that meets a latency target on this machine.
+      * @details Memory is raised first, doubling from 8 MB while the p99 latency at the given
+      *          concurrency stays within the target; passes are then raised at that memory.
+      *          The result is saved to the settings file and used for new hashes.
+      * @param targetMs The p99 latency target in milliseconds.
+      * @param concurrency The number of logins expected to hash at the same time.
+      * @return true if the settings were saved, false otherwise.
+      */
+     static bool calibrate(double targetMs, unsigned concurrency) {
+         const int rounds = 3;
+         unsigned long long bestOps = crypto_pwhash_OPSLIMIT_MIN;
+         size_t bestMem = 0;
+ 
+         for (size_t mem = 8u << 20; mem <= (size_t(1) << 30); mem *= 2) {
+             double p99 = measureP99(bestOps, mem, concurrency, rounds);
+             cout << "  m=" << (mem >> 20) << " MB, t=" << bestOps << ": p99 " << p99 << " ms" << endl;
+             if (p99 > targetMs) break;
+             bestMem = mem;
+         }
+         if (bestMem == 0) {
+             Terminal::printError("Even the smallest cost misses the latency target");
+             return false;
+         }
+ 
+         for (unsigned long long ops = bestOps + 1; ops <= 16; ops++) {
+             double p99 = measureP99(ops, bestMem, concurrency, rounds);
+             cout << "  m=" << (bestMem >> 20) << " MB, t=" << ops << ": p99 " << p99 << " ms" << endl;
+             if (p99 > targetMs) break;
+             bestOps = ops;
+         }
+ 
+         ofstream file(settingsFile);
+         file << "opslimit=" << bestOps << "\n" << "memlimit=" << bestMem << "\n" << "lanes=" << lanes << "\n";
+         if (!file) return false;
+         opslimit = bestOps;
+         memlimit = bestMem;
+         cout << "Selected opslimit=" << bestOps << ", memlimit=" << (bestMem >> 20) << " MB" << endl;
+         return true;
+     }
+ 
+     /**
+      * @brief Hashes the password on the hashing pool instead of the calling thread.
+      * @param password The password to hash.
+      * @param onComplete Optional callback run on the worker with the new credential.
+      * @return A future holding the credential, as returned by hashPassword().
+      */
+     static future<Credential> hashPasswordAsync(const string& password,
+                                                 function<void(const Credential&)> onComplete = nullptr) {
+         return pool().submit([password, onComplete] {
+             Credential credential = hashPassword(password);
+             if (onComplete) onComplete(credential);
+             return credential;
+         });
+     }
+ 
+     /**
+      * @brief Hashes the password with a fresh salt and the configured cost.
+      * @details Runs on the calling thread without any terminal output; interactive callers use
+      *          hashPasswordAsync() and animate with Terminal::loading() meanwhile.
+      * @param password The password to hash.
+      * @return The new credential, stored as an encoded hash.
+      */
+     static Credential hashPassword(const string& password) {
+         Credential credential;
+         credential.passes = opslimit;
+         credential.memlimit = memlimit / 1024 * 1024;  // Encoded hashes record whole KiB
+         credential.lanes = lanes;
+         credential.saltLength = crypto_pwhash_SALTBYTES;
+         credential.tagLength = 32;
+         salts().take(credential.salt);
+         computeTag(password, credential, credential.tag);
+         return credential;
+     }
+ 
+     /**
+      * @brief Sets the number of Argon2 lanes used for new hashes.
+      * @details The lane count is recorded in every encoded hash, so it can differ per record.
+      * @param count The number of lanes; 1 uses libsodium.
+      */
+     static void setLanes(uint32_t count) { lanes = max(1u, count); }
+ 
+     /**
+      * @brief Hashes in pooled, pre-faulted arenas from now on.
+      * @details The arenas, idle or in use, stay within the admission() budget, and none larger
+      *          than the current memory cost is kept; call it after changing either.
+      */
+     static void useArenas() {
+         Argon2::setArenaLimits(admission().getBudget(), memlimit);
+         Argon2::setArenaReuse(true);
+     }
+ 
+     /**
+      * @brief Checks if a stored credential was made with a different format or cost than the current one.
+      * @details Single-lane records are in crypto_pwhash_str format, so libsodium's
+      *          crypto_pwhash_str_needs_rehash decides for them; libsodium cannot read the lane
+      *          count of multi-lane records, so those are compared field by field.
+      * @param credential The stored credential.
+      * @return true if the record should be rehashed on the next successful login.
+      */
+     static bool needsRehash(const Credential& credential) {
+         if (credential.format != Credential::Format::Encoded) return true;  // Hex hashes predate encoded hashes
+         if (credential.lanes != lanes) return true;
+         if (credential.lanes == 1)
+             return credential.tagLength != 32 ||  // crypto_pwhash_str always writes 32-byte tags
+                    crypto_pwhash_str_needs_rehash(credential.hashText().c_str(), opslimit, memlimit) != 0;
+         return credential.passes != opslimit || credential.memlimit != memlimit / 1024 * 1024 ||
+                credential.tagLength != 32;
+     }
+ 
+     /**
+      * @brief Returns the pool that runs asynchronous hashing jobs.
+      * @return The shared hashing pool, created on first use.
+      */
+     static HashingPool& pool() {
+         static HashingPool workers;
+         return workers;
+     }
+ 
+     /**
+      * @brief Returns the pool of ready salts used for new hashes.
+      * @return The shared salt pool, created on first use.
+      */
+     static SaltPool& salts() {
+         static SaltPool pool;
+         return pool;
+     }
+ 
+     /**
+      * @brief Returns the gate that limits the memory used by concurrent hashes.
+      * @return The shared admission gate (1 GB budget by default).
+      */
+     static HashAdmissionGate& admission() {
+         static HashAdmissionGate gate(4 * crypto_pwhash_MEMLIMIT_MODERATE);
+         return gate;
+     }
+ 
+     /**
+      * @brief Sets how long a hash may wait for memory before it fails.
+      * @param timeout The admission deadline.
+      */
+     static void setAdmissionTimeout(chrono::milliseconds timeout) { admissionTimeout = timeout; }
+ 
+     /**
+      * @brief Runs Argon2id with a credential's salt and cost, without any terminal output.
+      * @details The hash first reserves its memory cost from admission(); it throws if the
+      *          memory does not become available before the admission deadline. libsodium
+      *          computes single-lane hashes unless arena mode is on; the Argon2 class does the rest.
+      * @param password The password to hash.
+      * @param credential The salt, cost and tag length to use.
+      * @param out Receives credential.tagLength bytes.
+      */
+     static void computeTag(const string& password, const Credential& credential, unsigned char* out) {
+         size_t mem = credential.memlimit;
+         if (!admission().acquire(mem, admissionTimeout))
+             throw runtime_error("Hashing queue timeout");
+ 
+         bool libsodium = credential.lanes == 1 && !Argon2::arenaReuse() &&
+                          credential.saltLength == crypto_pwhash_SALTBYTES &&
+                          credential.tagLength >= crypto_pwhash_BYTES_MIN;
+         int result = 0;
+         if (libsodium) {
+             result = crypto_pwhash(out, credential.tagLength, password.c_str(), password.size(), credential.salt,
+                                    credential.passes, mem, crypto_pwhash_ALG_ARGON2ID13);
+         } else {
+             try {
+                 Argon2::hash(out, credential.tagLength, password, credential.salt, credential.saltLength,
+                              credential.passes, mem / 1024, credential.lanes);
+             } catch (...) {
+                 result = -1;
+             }
+         }
+         admission().release(mem);
+         if (result != 0)
+             throw runtime_error("Hashing failed");
+     }
+ 
+     /**
+      * @brief Verifies if the given password matches a stored credential.
+      * @details The computed tag is compared with the stored one in constant time. When the
+      *          verified cache is on, a match within its TTL is answered without hashing.
+      * @param password The password to verify.
+      * @param credential The stored credential.
+      * @return true if the password matches, false otherwise.
+      * @throws runtime_error If the password could not be hashed, e.g. after an admission timeout.
+      */
+     static bool verifyPassword(const string& password, const Credential& credential) {
+         string mac;
+         if (verified().enabled()) {
+             mac = attemptDigest(password, credential);
+             if (verified().check(credentialId(credential), mac)) return true;
+         }
+         return hashAndCompare(password, credential, mac);
+     }
+ 
+     /**
+      * @brief Hashes the password and compares the result with the stored tag in constant time.
+      * @param password The password to verify.
+      * @param credential The stored credential.
+      * @param mac The password's MAC to remember on a match; empty to remember nothing.
+      * @return true if the password matches, false otherwise.
+      * @throws runtime_error If the password could not be hashed; that says nothing about the password.
+      */
+     static bool hashAndCompare(const string& password, const Credential& credential, const string& mac) {
+         unsigned char computed[Credential::maxBytes];
+         computeTag(password, credential, computed);
+         bool matches = sodium_memcmp(computed, credential.tag, credential.tagLength) == 0;
+         sodium_memzero(computed, sizeof computed);
+         if (matches && !mac.empty()) verified().remember(credentialId(credential), mac);
+         return matches;
+     }
+ 
+     /**
+      * @brief Returns the rate limiter that login attempts pass before they are hashed.
+      * @return The shared limiter, created on first use (10 attempts per user per minute with
+      *         bursts of 5; 2 attempts per second per core in total).
+      */
+     static LoginRateLimiter& limiter() {
+         static const double cores = max(1u, thread::hardware_concurrency());
+         static LoginRateLimiter rateLimiter(10, 5, 2 * cores, 4 * cores);
+         return rateLimiter;
+     }
+ 
+     /**
+      * @brief Decides if a login attempt may go on to be verified.
+      * @details Attempts the verified cache can answer cost nothing and are always let
+      *          through; the others take a token from limiter().
+      * @param username The username being tried.
+      * @param password The password being tried.
+      * @param credential The user's stored credential.
+      * @return true if the attempt may be verified, false if it must be refused.
+      */
+     static bool admitAttempt(const string& username, const string& password, const Credential& credential) {
+         if (verified().enabled() && verified().peek(credentialId(credential), attemptDigest(password, credential)))
+             return true;
+         return limiter().tryAcquire(username);
+     }
+ 
+     /**
+      * @brief Returns the opt-in cache of recent successful verifications.
+      * @return The shared verified cache, created on first use.
+      */
+     static VerifiedCache& verified() {
+         static VerifiedCache cache;
+         return cache;
+     }
+ 
+     /**
+      * @brief Returns a keyed BLAKE2b digest identifying a password and a stored credential.
+      * @details The key is random and never leaves the process, so the digest cannot be used
+      *          to test password guesses offline.
+      * @param password The password.
+      * @param credential The stored credential.
+      * @return A 32-byte digest.
+      */
+     static string attemptDigest(const string& password, const Credential& credential) {
+         static const auto key = [] {
+             array<unsigned char, crypto_generichash_KEYBYTES> bytes;
+             crypto_generichash_keygen(bytes.data());
+             return bytes;
+         }();
+         crypto_generichash_state state;
+         crypto_generichash_init(&state, key.data(), key.size(), crypto_generichash_BYTES);
+         uint64_t length = password.size();  // Keeps the password and the credential apart
+         crypto_generichash_update(&state, reinterpret_cast<const unsigned char*>(&length), sizeof length);
+         crypto_generichash_update(&state, reinterpret_cast<const unsigned char*>(password.data()), password.size());
+         crypto_generichash_update(&state, credential.salt, credential.saltLength);
+         crypto_generichash_update(&state, credential.tag, credential.tagLength);
+         uint64_t cost[3] = { credential.passes, credential.memlimit, credential.lanes };
+         crypto_generichash_update(&state, reinterpret_cast<const unsigned char*>(cost), sizeof cost);
+ 
+         string digest(crypto_generichash_BYTES, '\0');
+         crypto_generichash_final(&state, reinterpret_cast<unsigned char*>(&digest[0]), digest.size());
+         return digest;
+     }
+ 
+     /**
+      * @brief Returns the bytes that identify a stored credential: its salt and tag.
+      */
+     static string credentialId(const Credential& credential) {
+         return string(reinterpret_cast<const char*>(credential.salt), credential.saltLength) +
+                string(reinterpret_cast<const char*>(credential.tag), credential.tagLength);
+     }
+ 
+     /**
+      * @brief Returns the flights that let identical concurrent verifications share one hash.
+      * @return The shared single-flight table, created on first use.
+      */
+     static SingleFlight& flights() {
+         static SingleFlight table;
+         return table;
+     }
+ 
+     /**
+      * @brief Verifies a password on the hashing pool without blocking the caller.
+      * @details Retries and double-submits of an attempt that is still being hashed join that
+      *          hash instead of starting another one, and get the same result.
+      * @param password The password to verify.
+      * @param credential The stored credential.
+      * @param onComplete Optional callback run on the worker with the result, or with the
+      *                   exception if the password could not be hashed.
+      * @return A future that becomes ready with the result of verifyPassword(), or its exception.
+      */
+     static future<bool> verifyPasswordAsync(const string& password, const Credential& credential,
+                                             function<void(bool, exception_ptr)> onComplete = nullptr) {
+         string key = attemptDigest(password, credential);
+         bool cached = verified().enabled();
+         if (cached && verified().check(credentialId(credential), key)) {
+             if (onComplete) onComplete(true, nullptr);
+             promise<bool> hit;
+             hit.set_value(true);
+             return hit.get_future();
+         }
+         bool leader;
+         future<bool> result = flights().join(key, move(onComplete), leader);
+         if (leader) {
+             pool().submit([password, credential, key, cached] {
+                 try {
+                     flights().land(key, hashAndCompare(password, credential, cached ? key : ""));
+                 } catch (...) {
+                     flights().land(key, false, current_exception());
+                 }
+             });
+         }
+         return result;
+     }
+ 
+     /**
+      * @brief Verifies many passwords at once, hashing them in parallel on the pool.
+      * @param jobs The passwords and their stored credentials.
+      * @return The results, in the same order as 'jobs'.
+      * @throws runtime_error If a password could not be hashed.
+      */
+     static vector<bool> verifyBatch(const vector<VerifyJob>& jobs) {
+         vector<future<bool>> pending;
+         pending.reserve(jobs.size());
+         for (const VerifyJob& job : jobs) pending.push_back(verifyPasswordAsync(job.password, job.credential));
+ 
+         vector<bool> results;
+         results.reserve(jobs.size());
+         for (auto& result : pending) results.push_back(result.get());
+         return results;
+     }
+ };
+ 
+ #ifdef __cpp_impl_coroutine
+ /**
+  * @class VerifyAwaitable
+  * @brief Lets a C++20 coroutine co_await a password verification running on the hashing pool.
+  * @details The coroutine is suspended while Argon2 runs and is resumed on the worker thread
+  *          that finished the hash, so an event loop never blocks on it.
+  */
+ class VerifyAwaitable {
+ private:
+     PasswordHasher::VerifyJob job;  ///< The password and stored credential to check
+     bool result = false;  ///< The outcome, set before the coroutine resumes
+     exception_ptr error;  ///< Set instead if the password could not be hashed
+ 
+ public:
+     /**
+      * @brief Constructor: captures the password and the stored credential.
+      * @param password The password to verify.
+      * @param credential The stored credential.
+      */
+     VerifyAwaitable(string password, const Credential& credential)
+         : job{move(password), credential} {}
+ 
+     bool await_ready() const noexcept { return false; }
+ 
+     void await_suspend(coroutine_handle<> handle) {
+         PasswordHasher::verifyPasswordAsync(job.password, job.credential,
+                                             [this, handle](bool verified, exception_ptr failure) {
+             result = verified;
+             error = failure;
+             handle.resume();
+         });
+     }
+ 
+     bool await_resume() const {
+         if (error) rethrow_exception(error);
+         return result;
+     }
+ };
+ #endif
+ 
+ chrono::milliseconds PasswordHasher::admissionTimeout(10000);  ///< Static member variable for the admission deadline (10 s)
+ unsigned long long PasswordHasher::opslimit = crypto_pwhash_OPSLIMIT_MODERATE;  ///< Static member variable for the Argon2 passes
+ size_t PasswordHasher::memlimit = crypto_pwhash_MEMLIMIT_MODERATE;  ///< Static member variable for the Argon2 memory
+ uint32_t PasswordHasher::lanes = 1;  ///< Static member variable for the Argon2 lanes
+ const string PasswordHasher::settingsFile = "argon2.conf";  ///< Static constant string for the calibration result file
+ 
+ /**
+  * @class SessionTokens
+  * @brief Issues and checks stateless session tokens, so a logged-in user skips Argon2 afterwards.
+  * @details A token carries the username and an expiry time, authenticated with crypto_auth
+  *          (HMAC-SHA-512-256) under a random key that never leaves the process. Checking a
+  *          token is one MAC over a few dozen bytes and needs no server-side state; tokens
+  *          stop working when they expire or when the process restarts.
+  */
+ class SessionTokens {
+ private:
+     static const uint8_t version = 1;  ///< Layout of the token payload
+     static const size_t maxTokenBytes = 512;  ///< Longest token accepted
+     static chrono::seconds ttl;  ///< Lifetime of new tokens
+ 
+     /**
+      * @brief Returns the MAC key, drawn at random on first use.
+      */
+     static const array<unsigned char, crypto_auth_KEYBYTES>& key() {
+         static const auto bytes = [] {
+             array<unsigned char, crypto_auth_KEYBYTES> k;
+             crypto_auth_keygen(k.data());
+             return k;
+         }();
+         return bytes;
+     }
+ 
+     /**
+      * @brief Returns the current time in seconds since the Unix epoch.
+      */
+     static uint64_t now() {
+         return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+     }
+ 
+ public:
+     /**
+      * @brief Sets the lifetime of new tokens.
+      * @param lifetime How long a token stays valid after it is issued.
+      */
+     static void setTtl(chrono::seconds lifetime) { ttl = lifetime; }
+ 
+     /**
+      * @brief Issues a token for a user who has just proved their password.
+      * @param username The authenticated user.
+      * @return The token, in URL-safe base64.
+      */
+     static string issue(const string& username) {
+         // version (1 byte) | expiry (8 bytes, little-endian) | username | MAC (32 bytes)
+         vector<unsigned char> token(1 + 8 + username.size() + crypto_auth_BYTES);
+         uint64_t expires = now() + ttl.count();
+         token[0] = version;
+         for (int i = 0; i < 8; i++) token[1 + i] = uint8_t(expires >> (8 * i));
+         memcpy(&token[9], username.data(), username.size());
+         size_t payload = token.size() - crypto_auth_BYTES;
+         crypto_auth(&token[payload], token.data(), payload, key().data());
+ 
+         const int variant = sodium_base64_VARIANT_URLSAFE_NO_PADDING;
+         vector<char> text(sodium_base64_ENCODED_LEN(token.size(), variant));
+         sodium_bin2base64(text.data(), text.size(), token.data(), token.size(), variant);
+         return string(text.data());
+     }
+ 
+     /**
+      * @brief Checks a token and extracts the user it was issued to.
+      * @param token The token returned by issue().
+      * @param username Receives the user on success.
+      * @param remaining Receives the time left before the token expires.
+      * @return true if the token is authentic and unexpired, false otherwise.
+      */
+     static bool validate(const string& token, string& username, chrono::seconds& remaining) {
+         if (token.size() > maxTokenBytes) return false;
+         unsigned char bytes[maxTokenBytes];
+         size_t length;
+         if (sodium_base642bin(bytes, sizeof bytes, token.data(), token.size(), nullptr, &length, nullptr,
+                               sodium_base64_VARIANT_URLSAFE_NO_PADDING) != 0) return false;
+         if (length < 1 + 8 + crypto_auth_BYTES) return false;
+         size_t payload = length - crypto_auth_BYTES;
+         if (crypto_auth_verify(&bytes[payload], bytes, payload, key().data()) != 0) return false;
+         if (bytes[0] != version) return false;
+ 
+         uint64_t expires = 0;
+         for (int i = 0; i < 8; i++) expires |= uint64_t(bytes[1 + i]) << (8 * i);
+         uint64_t current = now();
+         if (expires <= current) return false;
+         username.assign(reinterpret_cast<const char*>(&bytes[9]), payload - 9);
+         remaining = chrono::seconds(expires - current);
+         return true;
+     }
+ };
+ 
+ chrono::seconds SessionTokens::ttl(15 * 60);  ///< Static member variable for the token lifetime (15 minutes)
+ 
+ /**
+  * @class ProofOfWork
+  * @brief Hands out BLAKE2b proof-of-work challenges that clients solve before a login is hashed under overload.
+  * @details While the hashing queue is short no challenge is needed. Once it backs up, each
+  *          login must first find a counter whose BLAKE2b hash, together with the challenge
+  *          and username, starts with a number of zero bits; every doubling of the backlog adds
+  *          two bits, i.e. four times the client work, while checking a solution costs the
+  *          server a single hash. Challenges are stateless (authenticated with crypto_auth and
+  *          expiring after a minute); only solved ones are remembered, to refuse replays.
+  */
+ class ProofOfWork {
+ private:
+     static constexpr uint8_t version = 1;  ///< Layout of the challenge
+     static constexpr size_t nonceBytes = 16;  ///< Random bytes that make each challenge unique
+     static constexpr size_t payloadBytes = 1 + 1 + 8 + nonceBytes;  ///< version | bits | expiry | nonce
+     static constexpr uint64_t lifetimeSeconds = 60;  ///< How long a challenge may be solved and used
+     static constexpr unsigned baseBits = 12;  ///< Difficulty when the queue just reaches its threshold
+     static constexpr unsigned maxBits = 22;  ///< Highest difficulty handed out (about a second of client work)
+     static mutex usedLock;  ///< Protects 'used' and 'expiries'
+     static unordered_set<string> used;  ///< Nonces of accepted solutions whose challenge has not expired
+     static priority_queue<pair<uint64_t, string>, vector<pair<uint64_t, string>>,
+                           greater<pair<uint64_t, string>>> expiries;  ///< The same nonces, soonest expiry on top
+ 
+     /**
+      * @brief Returns the MAC key, drawn at random on first use.
+      */
+     static const array<unsigned char, crypto_auth_KEYBYTES>& key() {
+         static const auto bytes = [] {
+             array<unsigned char, crypto_auth_KEYBYTES> k;
+             crypto_auth_keygen(k.data());
+             return k;
+         }();
+         return bytes;
+     }
+ 
+     /**
+      * @brief Returns the current time in seconds since the Unix epoch.
+      */
+     static uint64_t now() {
+         return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+     }
+ 
+     /**
+      * @brief Computes the MAC that binds a challenge payload to a username.
+      */
+     static void authenticate(const unsigned char* payload, const string& username, unsigned char* mac) {
+         vector<unsigned char> message(payload, payload + payloadBytes);
+         message.insert(message.end(), username.begin(), username.end());
+         crypto_auth(mac, message.data(), message.size(), key().data());
+     }
+ 
+     /**
+      * @brief Counts the leading zero bits of BLAKE2b(payload | username | counter).
+      */
+     static unsigned zeroBits(const unsigned char* payload, const string& username, uint64_t counter) {
+         unsigned char digest[crypto_generichash_BYTES], counterBytes[8];
+         for (int i = 0; i < 8; i++) counterBytes[i] = uint8_t(counter >> (8 * i));
+         crypto_generichash_state state;
+         crypto_generichash_init(&state, nullptr, 0, sizeof digest);
+         crypto_generichash_update(&state, payload, payloadBytes);
+         crypto_generichash_update(&state, reinterpret_cast<const unsigned char*>(username.data()), username.size());
+         crypto_generichash_update(&state, counterBytes, sizeof counterBytes);
+         crypto_generichash_final(&state, digest, sizeof digest);
+ 
+         unsigned bits = 0;
+         for (unsigned char byte : digest) {
+             if (byte) return bits + __builtin_clz(byte) - 24;
+             bits += 8;
+         }
+         return bits;
+     }
+ 
+     /**
+      * @brief Decodes a challenge and checks that it was issued by this process for this user.
+      * @return true if the challenge is authentic, false otherwise.
+      */
+     static bool decode(const string& challenge, const string& username, unsigned char* payload) {
+         unsigned char bytes[payloadBytes + crypto_auth_BYTES], mac[crypto_auth_BYTES];
+         size_t length;
+         if (sodium_base642bin(bytes, sizeof bytes, challenge.data(), challenge.size(), nullptr, &length, nullptr,
+                               sodium_base64_VARIANT_URLSAFE_NO_PADDING) != 0 || length != sizeof bytes)
+             return false;
+         authenticate(bytes, username, mac);
+         if (sodium_memcmp(mac, bytes + payloadBytes, sizeof mac) != 0 || bytes[0] != version) return false;
+         memcpy(payload, bytes, payloadBytes);
+         return true;
+     }
+ 
+ public:
+     /**
+      * @brief Returns the difficulty the current hashing backlog calls for.
+      * @details The backlog is the jobs waiting for a pool worker plus the hashes waiting for
+      *          memory; the threshold is twice the number of workers.
+      * @return The number of leading zero bits required, or 0 if no challenge is needed.
+      */
+     static unsigned difficulty() {
+         size_t backlog = PasswordHasher::pool().pending() + PasswordHasher::admission().snapshot().queueDepth;
+         size_t threshold = 2 * PasswordHasher::pool().size();
+         if (backlog < threshold) return 0;
+         unsigned doublings = 0;
+         while (backlog >= threshold << (doublings + 1)) doublings++;
+         return min(maxBits, baseBits + 2 * doublings);
+     }
+ 
+     /**
+      * @brief Issues a challenge for a login attempt if the service is overloaded.
+      * @param username The user about to log in.
+      * @return The challenge in URL-safe base64, or an empty string if none is needed.
+      */
+     static string challengeFor(const string& username) {
+         unsigned bits = difficulty();
+         if (bits == 0) return "";
+ 
+         unsigned char bytes[payloadBytes + crypto_auth_BYTES];
+         uint64_t expires = now() + lifetimeSeconds;
+         bytes[0] = version;
+         bytes[1] = uint8_t(bits);
+         for (int i = 0; i < 8; i++) bytes[2 + i] = uint8_t(expires >> (8 * i));
+         randombytes_buf(bytes + 10, nonceBytes);
+         authenticate(bytes, username, bytes + payloadBytes);
+ 
+         const int variant = sodium_base64_VARIANT_URLSAFE_NO_PADDING;
+         char text[sodium_base64_ENCODED_LEN(sizeof bytes, variant)];
+         sodium_bin2base64(text, sizeof text, bytes, sizeof bytes, variant);
+         return text;
+     }
+ 
+     /**
+      * @brief Solves a challenge; this is the client's side of the exchange.
+      * @param challenge The challenge returned by challengeFor().
+      * @param username The user the challenge was issued for.
+      * @return The counter that meets the difficulty.
+      * @throws runtime_error If the challenge is malformed.
+      */
+     static uint64_t solve(const string& challenge, const string& username) {
+         unsigned char bytes[payloadBytes + crypto_auth_BYTES];  // The client cannot check the MAC
+         size_t length;
+         if (sodium_base642bin(bytes, sizeof bytes, challenge.data(), challenge.size(), nullptr, &length, nullptr,
+                               sodium_base64_VARIANT_URLSAFE_NO_PADDING) != 0 || length != sizeof bytes)
+             throw runtime_error("Malformed proof-of-work challenge");
+         uint64_t counter = 0;
+         while (zeroBits(bytes, username, counter) < bytes[1]) counter++;
+         return counter;
+     }
+ 
+     /**
+      * @brief Checks a solution and accepts each challenge only once.
+      * @details Nonces are forgotten once their challenge expires, popped from a heap in
+      *          expiry order, so each call does logarithmic work however many are remembered.
+      * @param challenge The challenge returned by challengeFor().
+      * @param username The user logging in.
+      * @param solution The counter returned by solve().
+      * @return true if the challenge is authentic, unexpired, unused and solved, false otherwise.
+      */
+     static bool verify(const string& challenge, const string& username, uint64_t solution) {
+         unsigned char payload[payloadBytes];
+         if (!decode(challenge, username, payload)) return false;
+         uint64_t expires = 0;
+         for (int i = 0; i < 8; i++) expires |= uint64_t(payload[2 + i]) << (8 * i);
+         uint64_t current = now();
+         if (expires <= current || zeroBits(payload, username, solution) < payload[1]) return false;
+ 
+         string nonce(reinterpret_cast<const char*>(payload + 10), nonceBytes);
+         lock_guard<mutex> guard(usedLock);
+         while (!expiries.empty() && expiries.top().first <= current) {  // Expired challenges are refused anyway
+             used.erase(expiries.top().second);
+             expiries.pop();
+         }
+         if (!used.insert(nonce).second) return false;
+         expiries.emplace(expires, move(nonce));
+         return true;
+     }
+ };
+ 
+ mutex ProofOfWork::usedLock;  ///< Static member variable that guards the used nonces
+ unordered_set<string> ProofOfWork::used;  ///< Static member variable for the nonces of accepted solutions
+ priority_queue<pair<uint64_t, string>, vector<pair<uint64_t, string>>, greater<pair<uint64_t, string>>>
+     ProofOfWork::expiries;  ///< Static member variable that orders the used nonces by expiry
+ 
+ /**
+  * @class FrontCodedIndex
+  * @brief Stores a sorted list of usernames as front-coded blocks with restart points.
+  * @details Each entry only keeps the suffix that differs from the previous entry. Every
+  *          blockSize entries a restart point stores the full key, so a lookup binary-searches
+  *          the restart points and then decodes at most one block.
+  */
+ class FrontCodedIndex {
+ private:
+     static const size_t blockSize = 16;  ///< Number of entries between two restart points
+     string data;  ///< Encoded entries: varint shared length, varint suffix length, suffix bytes
+     vector<uint32_t> restarts;  ///< Offsets in 'data' of the first (full) entry of each block
+     size_t count = 0;  ///< Number of keys in the index
+ 
+     /**
+      * @brief Appends an unsigned integer in LEB128 varint form.
+      * @param out The buffer to append to.
+      * @param value The value to encode.
+      */
+     static void putVarint(string& out, uint32_t value) {
+         while (value >= 0x80) {
+             out.push_back(char((value & 0x7f) | 0x80));
+             value >>= 7;
+         }
+         out.push_back(char(value));
+     }
+ 
+     /**
+      * @brief Reads a LEB128 varint and advances the position.
+      * @param pos The position in 'data', updated past the varint.
+      * @return The decoded value.
+      */
+     uint32_t getVarint(size_t& pos) const {
+         uint32_t value = 0;
+         for (int shift = 0; pos < data.size(); shift += 7) {
+             unsigned char byte = data[pos++];
+             value |= uint32_t(byte & 0x7f) << shift;
+             if (!(byte & 0x80)) break;
+         }
+         return value;
+     }
+ 
+     /**
+      * @brief Decodes the entry at 'pos' on top of the previous key.
+      * @param pos The position of the entry, updated past it.
+      * @param key The previous key, replaced by the decoded key.
+      */
+     void decodeNext(size_t& pos, string& key) const {
+         uint32_t shared = getVarint(pos);
+         uint32_t length = getVarint(pos);
+         key.resize(shared);
+         key.append(data, pos, length);
+         pos += length;
+     }
+ 
+ public:
+     /**
+      * @brief Builds the index from keys that are already sorted and unique.
+      * @param sortedKeys The keys in ascending order.
+      */
+     void build(const vector<string>& sortedKeys) {
+         data.clear();
+         restarts.clear();
+         count = sortedKeys.size();
+ 
+         string previous;
+         for (size_t i = 0; i < sortedKeys.size(); i++) {
+             const string& key = sortedKeys[i];
+             size_t shared = 0;
+             if (i % blockSize == 0) {
+                 restarts.push_back(data.size());  // Restart entries store the full key
+             } else {
+                 size_t limit = min(previous.size(), key.size());
+                 while (shared < limit && previous[shared] == key[shared]) shared++;
+             }
+             putVarint(data, shared);
+             putVarint(data, key.size() - shared);
+             data.append(key, shared, string::npos);
+             previous = key;
+         }
+     }
+ 
+     /**
+      * @brief Finds the position of a key in the sorted order.
+      * @param key The key to look for.
+      * @return The position of the key, or -1 if it is not present.
+      */
+     long find(const string& key) const {
+         if (restarts.empty()) return -1;
+ 
+         // Binary search for the last block whose first key is <= key
+         size_t lo = 0, hi = restarts.size();
+         string first;
+         while (hi - lo > 1) {
+             size_t mid = (lo + hi) / 2;
+             size_t pos = restarts[mid];
+             first.clear();
+             decodeNext(pos, first);
+             if (first <= key) lo = mid; else hi = mid;
+         }
+ 
+         // Decode within the block only
+         size_t pos = restarts[lo];
+         size_t end = lo + 1 < restarts.size() ? restarts[lo + 1] : data.size();
+         string current;
+         for (size_t i = lo * blockSize; pos < end; i++) {
+             decodeNext(pos, current);
+             if (current == key) return long(i);
+             if (current > key) break;
+         }
+         return -1;
+     }
+ 
+     /**
+      * @brief Returns the key stored at a given position.
+      * @param index The position of the key.
+      * @return The decoded key.
+      */
+     string at(size_t index) const {
+         size_t pos = restarts[index / blockSize];
+         string key;
+         for (size_t i = 0; i <= index % blockSize; i++) decodeNext(pos, key);
+         return key;
+     }
+ 
+     /**
+      * @brief Returns the number of keys in the index.
+      * @return The number of keys.
+      */
+     size_t size() const { return count; }
+ 
+     /**
+      * @brief Returns the number of bytes used by the encoded keys and restart points.
+      * @return The encoded size in bytes.
+      */
+     size_t byteSize() const { return data.size() + restarts.size() * sizeof(uint32_t); }
+ 
+     /**
+      * @brief Writes the index to a binary stream.
+      * @param out The stream to write to.
+      */
+     void write(ostream& out) const {
+         uint64_t header[3] = { count, restarts.size(), data.size() };
+         out.write(reinterpret_cast<const char*>(header), sizeof header);
+         out.write(reinterpret_cast<const char*>(restarts.data()), restarts.size() * sizeof(uint32_t));
+         out.write(data.data(), data.size());
+     }
+ 
+     /**
+      * @brief Reads an index previously written with write().
+      * @param in The stream to read from.
+      * @return true if the index was read successfully, false otherwise.
+      */
+     bool read(istream& in) {
+         uint64_t header[3];
+         if (!in.read(reinterpret_cast<char*>(header), sizeof header)) return false;
+         count = header[0];
+         restarts.resize(header[1]);
+         data.resize(header[2]);
+         in.read(reinterpret_cast<char*>(restarts.data()), restarts.size() * sizeof(uint32_t));
+         in.read(&data[0], data.size());
+         return bool(in);
+     }
+ };
+ 
+ /**
+  * @class MinimalPerfectHash
+  * @brief Maps a fixed set of usernames to distinct slots 0..n-1 (BBHash-style).
+  * @details Keys are hashed into a bit array per level; keys that land alone on a bit are
+  *          placed, colliding keys move on to the next level. The slot of a key is the rank of
+  *          its bit across all levels. With gamma = 1 this costs about 3 bits per key plus the
+  *          rank table. Keys that never settle are kept in a small fallback map.
+  */
+ class MinimalPerfectHash {
+ private:
+     static const int maxLevels = 32;  ///< Keys still colliding after this go to the fallback map
+     vector<uint64_t> bits;  ///< Concatenated bit arrays of all levels
+     vector<uint32_t> ranks;  ///< Number of set bits before each 512-bit block
+     vector<uint64_t> levelOffsets;  ///< First bit of each level in 'bits'
+     vector<uint64_t> levelSizes;  ///< Number of bits in each level
+     map<string, uint32_t> fallback;  ///< Keys that collided on every level
+     uint64_t keyCount = 0;  ///< Number of keys in the function
+ 
+     /**
+      * @brief Finalizer from SplitMix64, used to derive per-level hashes.
+      */
+     static uint64_t mix(uint64_t x) {
+         x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+         x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+         return x ^ (x >> 31);
+     }
+ 
+     /**
+      * @brief Returns the bit position of a key hash on a given level.
+      */
+     uint64_t position(uint64_t hash, size_t level) const {
+         uint64_t h = mix(hash + (level + 1) * 0x9e3779b97f4a7c15ULL);
+         return levelOffsets[level] + ((h >> 32) * levelSizes[level] >> 32);
+     }
+ 
+     bool testBit(uint64_t bit) const { return (bits[bit / 64] >> (bit % 64)) & 1; }
+ 
+     /**
+      * @brief Counts the set bits before a given bit.
+      */
+     uint64_t rank(uint64_t bit) const {
+         uint64_t count = ranks[bit / 512];
+         for (uint64_t word = bit / 512 * 8; word < bit / 64; word++)
+             count += __builtin_popcountll(bits[word]);
+         return count + __builtin_popcountll(bits[bit / 64] & ((1ULL << (bit % 64)) - 1));
+     }
+ 
+     /**
+      * @brief Rebuilds the rank table from 'bits'.
+      */
+     void buildRanks() {
+         ranks.assign(bits.size() / 8 + 1, 0);
+         uint64_t count = 0;
+         for (size_t word = 0; word < bits.size(); word++) {
+             if (word % 8 == 0) ranks[word / 8] = count;
+             count += __builtin_popcountll(bits[word]);
+         }
+         if (bits.size() % 8 == 0) ranks.back() = count;
+     }
+ 
+ public:
+     /**
+      * @brief Hashes a key to 64 bits with a given seed.
+      * @param key The key to hash.
+      * @param seed The seed of the hash function.
+      * @return The 64-bit hash.
+      */
+     static uint64_t hashKey(const string& key, uint64_t seed = 0) {
+         uint64_t h = mix(seed ^ (key.size() * 0x9e3779b97f4a7c15ULL));
+         size_t i = 0;
+         for (; i + 8 <= key.size(); i += 8) {
+             uint64_t chunk;
+             memcpy(&chunk, key.data() + i, 8);
+             h = mix(h ^ chunk);
+         }
+         uint64_t tail = 0;
+         memcpy(&tail, key.data() + i, key.size() - i);
+         return mix(h ^ tail);
+     }
+ 
+     /**
+      * @brief Builds the function over a set of distinct keys.
+      * @param keys The keys; every key must be unique.
+      * @param gamma Bits per remaining key on each level; larger is faster but bigger.
+      */
+     void build(const vector<string>& keys, double gamma = 1.0) {
+         keyCount = keys.size();
+         bits.clear();
+         levelOffsets.clear();
+         levelSizes.clear();
+         fallback.clear();
+ 
+         vector<uint64_t> hashes(keys.size());
+         for (size_t i = 0; i < keys.size(); i++) hashes[i] = hashKey(keys[i]);
+         vector<uint32_t> remaining(keys.size());
+         for (size_t i = 0; i < keys.size(); i++) remaining[i] = i;
+ 
+         for (size_t level = 0; level < maxLevels && !remaining.empty(); level++) {
+             uint64_t size = max<uint64_t>(64, uint64_t(remaining.size() * gamma + 63) / 64 * 64);
+             levelOffsets.push_back(bits.size() * 64);
+             levelSizes.push_back(size);
+             bits.resize(bits.size() + size / 64, 0);
+ 
+             // Mark every bit hit once, then every bit hit more than once
+             vector<uint64_t> seen(size / 64, 0), collided(size / 64, 0);
+             for (uint32_t key : remaining) {
+                 uint64_t bit = position(hashes[key], level) - levelOffsets[level];
+                 uint64_t mask = 1ULL << (bit % 64);
+                 if (seen[bit / 64] & mask) collided[bit / 64] |= mask;
+                 seen[bit / 64] |= mask;
+             }
+ 
+             vector<uint32_t> next;
+             for (uint32_t key : remaining) {
+                 uint64_t bit = position(hashes[key], level);
+                 uint64_t local = bit - levelOffsets[level];
+                 if (collided[local / 64] & (1ULL << (local % 64))) next.push_back(key);
+                 else bits[bit / 64] |= 1ULL << (bit % 64);
+             }
+             remaining.swap(next);
+         }
+ 
+         buildRanks();
+         uint64_t placed = keyCount - remaining.size();
+         for (size_t i = 0; i < remaining.size(); i++) fallback[keys[remaining[i]]] = placed + i;
+     }
+ 
+     /**
+      * @brief Returns the slot of a key.
+      * @param key The key to look up.
+      * @return A slot in 0..size()-1, or -1 if the key certainly is not in the set. Keys that
+      *         are not in the set may also map to a valid slot; callers must check the record.
+      */
+     long lookup(const string& key) const {
+         uint64_t hash = hashKey(key);
+         for (size_t level = 0; level < levelSizes.size(); level++) {
+             uint64_t bit = position(hash, level);
+             if (testBit(bit)) return long(rank(bit));
+         }
+         auto it = fallback.find(key);
+         return it == fallback.end() ? -1 : long(it->second);
+     }
+ 
+     /**
+      * @brief Returns the number of keys in the function.
+      * @return The number of keys.
+      */
+     size_t size() const { return keyCount; }
+ 
+     /**
+      * @brief Returns the space used per key, including the rank table.
+      * @return The number of bits per key.
+      */
+     double bitsPerKey() const {
+         return keyCount ? (bits.size() * 64.0 + ranks.size() * 32.0) / keyCount : 0;
+     }
+ 
+     /**
+      * @brief Writes the function to a binary stream.
+      * @param out The stream to write to.
+      */
+     void write(ostream& out) const {
+         uint64_t header[4] = { keyCount, levelSizes.size(), bits.size(), fallback.size() };
+         out.write(reinterpret_cast<const char*>(header), sizeof header);
+         out.write(reinterpret_cast<const char*>(levelOffsets.data()), levelOffsets.size() * sizeof(uint64_t));
+         out.write(reinterpret_cast<const char*>(levelSizes.data()), levelSizes.size() * sizeof(uint64_t));
+         out.write(reinterpret_cast<const char*>(bits.data()), bits.size() * sizeof(uint64_t));
+         for (const auto& [key, slot] : fallback) {
+             uint32_t length = key.size();
+             out.write(reinterpret_cast<const char*>(&length), sizeof length);
+             out.write(key.data(), length);
+             out.write(reinterpret_cast<const char*>(&slot), sizeof slot);
+         }
+     }
+ 
+     /**
+      * @brief Reads a function previously written with write().
+      * @param in The stream to read from.
+      * @return true if the function was read successfully, false otherwise.
+      */
+     bool read(istream& in) {
+         uint64_t header[4];
+         if (!in.read(reinterpret_cast<char*>(header), sizeof header)) return false;
+         keyCount = header[0];
+         levelOffsets.resize(header[1]);
+         levelSizes.resize(header[1]);
+         bits.resize(header[2]);
+         in.read(reinterpret_cast<char*>(levelOffsets.data()), levelOffsets.size() * sizeof(uint64_t));
+         in.read(reinterpret_cast<char*>(levelSizes.data()), levelSizes.size() * sizeof(uint64_t));
+         in.read(reinterpret_cast<char*>(bits.data()), bits.size() * sizeof(uint64_t));
+         fallback.clear();
+         for (uint64_t i = 0; i < header[3] && in; i++) {
+             uint32_t length, slot;
+             in.read(reinterpret_cast<char*>(&length), sizeof length);
+             string key(length, '\0');
+             in.read(&key[0], length);
+             in.read(reinterpret_cast<char*>(&slot), sizeof slot);
+             fallback[key] = slot;
+         }
+         buildRanks();
+         return bool(in);
+     }
+ };
+ 
+ /**
+  * @class CredentialSnapshot
+  * @brief A read-only snapshot of all credentials stored in a binary file.
+  * @details Usernames are front-coded with FrontCodedIndex. A MinimalPerfectHash built at write
+  *          time maps each username to its slot in a dense record array, so a lookup is a
+  *          single probe; a 64-bit username fingerprint in the record rejects unknown users.
+  */
+ class CredentialSnapshot {
+ private:
+     static const char magic[8];  ///< Identifies snapshot files
+     static const uint64_t fingerprintSeed = 0x5eed;  ///< Seed of the username fingerprint
+ 
+     /**
+      * @brief A credential record stored at the slot given by the perfect hash.
+      */
+     struct Record {
+         uint64_t fingerprint = 0;  ///< Hash of the username, to reject keys outside the set
+         Credential credential;  ///< The stored credential
+     };
+ 
+     FrontCodedIndex index;  ///< Sorted usernames
+     MinimalPerfectHash slots;  ///< Username to record slot
+     vector<Record> records;  ///< Records in slot order
+ 
+     /**
+      * @brief Writes a credential as fixed-width fields followed by its salt and tag bytes.
+      */
+     static void writeCredential(ostream& out, const Credential& credential) {
+         uint8_t format = uint8_t(credential.format);
+         uint64_t passes = credential.passes, memlimit = credential.memlimit;
+         uint32_t lanes = credential.lanes;
+         uint8_t saltLength = credential.saltLength, tagLength = credential.tagLength;
+         out.write(reinterpret_cast<const char*>(&format), sizeof format);
+         out.write(reinterpret_cast<const char*>(&passes), sizeof passes);
+         out.write(reinterpret_cast<const char*>(&memlimit), sizeof memlimit);
+         out.write(reinterpret_cast<const char*>(&lanes), sizeof lanes);
+         out.write(reinterpret_cast<const char*>(&saltLength), sizeof saltLength);
+         out.write(reinterpret_cast<const char*>(credential.salt), saltLength);
+         out.write(reinterpret_cast<const char*>(&tagLength), sizeof tagLength);
+         out.write(reinterpret_cast<const char*>(credential.tag), tagLength);
+     }
+ 
+     /**
+      * @brief Reads a credential written by writeCredential().
+      */
+     static bool readCredential(istream& in, Credential& credential) {
+         uint8_t format, saltLength, tagLength;
+         uint64_t passes, memlimit;
+         uint32_t lanes;
+         in.read(reinterpret_cast<char*>(&format), sizeof format);
+         in.read(reinterpret_cast<char*>(&passes), sizeof passes);
+         in.read(reinterpret_cast<char*>(&memlimit), sizeof memlimit);
+         in.read(reinterpret_cast<char*>(&lanes), sizeof lanes);
+         if (!in.read(reinterpret_cast<char*>(&saltLength), sizeof saltLength) || saltLength > Credential::maxBytes)
+             return false;
+         in.read(reinterpret_cast<char*>(credential.salt), saltLength);
+         if (!in.read(reinterpret_cast<char*>(&tagLength), sizeof tagLength) || tagLength > Credential::maxBytes)
+             return false;
+         in.read(reinterpret_cast<char*>(credential.tag), tagLength);
+         credential.format = Credential::Format(format);
+         credential.passes = passes;
+         credential.memlimit = memlimit;
+         credential.lanes = lanes;
+         credential.saltLength = saltLength;
+         credential.tagLength = tagLength;
+         return bool(in);
+     }
+ 
+ public:
+     /**
+      * @brief Writes a snapshot of the given users to a file.
+      * @param path The snapshot file to create.
+      * @param users The users and their credentials, already sorted by username.
+      * @return true if the snapshot was written successfully, false otherwise.
+      */
+     static bool write(const string& path, const map<string, Credential>& users) {
+         vector<string> names;
+         names.reserve(users.size());
+         for (const auto& entry : users) names.push_back(entry.first);
+ 
+         FrontCodedIndex index;
+         index.build(names);
+         MinimalPerfectHash slots;
+         slots.build(names);
+ 
+         vector<Record> records(users.size());
+         for (const auto& [user, credential] : users) {
+             Record& record = records[slots.lookup(user)];
+             record.fingerprint = MinimalPerfectHash::hashKey(user, fingerprintSeed);
+             record.credential = credential;
+         }
+ 
+         ofstream file(path, ios::binary);
+         if (!file) return false;
+         file.write(magic, sizeof magic);
+         index.write(file);
+         slots.write(file);
+         for (const auto& record : records) {
+             file.write(reinterpret_cast<const char*>(&record.fingerprint), sizeof record.fingerprint);
+             writeCredential(file, record.credential);
+         }
+         return bool(file);
+     }
+ 
+     /**
+      * @brief Loads a snapshot file.
+      * @param path The snapshot file to read.
+      * @return true if the snapshot was loaded successfully, false otherwise.
+      */
+     bool open(const string& path) {
+         ifstream file(path, ios::binary);
+         char header[sizeof magic];
+         if (!file.read(header, sizeof header) || !equal(header, header + sizeof header, magic))
+             return false;
+         if (!index.read(file) || !slots.read(file)) return false;
+ 
+         records.resize(index.size());
+         for (auto& record : records) {
+             file.read(reinterpret_cast<char*>(&record.fingerprint), sizeof record.fingerprint);
+             if (!readCredential(file, record.credential)) return false;
+         }
+         return true;
+     }
+ 
+     /**
+      * @brief Retrieves the credential of a given username with a single record probe.
+      * @param username The username to retrieve credentials for.
+      * @param credential Receives the stored credential.
+      * @return true if credentials are found, false otherwise.
+      */
+     bool getCredentials(const string& username, Credential& credential) const {
+         long slot = slots.lookup(username);
+         if (slot < 0 || size_t(slot) >= records.size()) return false;
+         const Record& record = records[slot];
+         if (record.fingerprint != MinimalPerfectHash::hashKey(username, fingerprintSeed)) return false;
+         credential = record.credential;
+         return true;
+     }
+ 
+     /**
+      * @brief Checks if a username is in the snapshot using the sorted index only.
+      * @param username The username to check.
+      * @return true if the user exists, false otherwise.
+      */
+     bool contains(const string& username) const { return index.find(username) >= 0; }
+ 
+     /**
+      * @brief Returns the number of users in the snapshot.
+      * @return The number of users.
+      */
+     size_t size() const { return index.size(); }
+ };
+ 
+ const char CredentialSnapshot::magic[8] = { 'A', 'U', 'T', 'H', 'S', 'N', 'P', '3' };  ///< Snapshot file signature
+ 
+ /**
+  * @class AsyncLogWriter
+  * @brief Appends to a file from a background thread, batching writes and syncs.
+  * @details append() only queues the bytes and returns. The writer thread takes everything
+  *          queued so far, writes it with a single call and syncs it to disk once per batch,
+  *          so callers never wait for the disk. If a write or sync fails, the data is not
+  *          counted as durable: waiters are released with the failure and later appends throw.
+  */
+ class AsyncLogWriter {
+ private:
+     FILE* file = nullptr;  ///< The file being appended to
+     string path;  ///< Name of the file, for error messages
+     thread worker;  ///< Writes and syncs queued batches
+     mutex lock;  ///< Protects the members below
+     condition_variable wake;  ///< Signals the worker that data is queued
+     condition_variable synced;  ///< Signals waiters that a batch is on disk
+     string queued;  ///< Bytes waiting to be written
+     uint64_t queuedEnd = 0;  ///< Logical size of the file once everything queued is written
+     uint64_t durableEnd = 0;  ///< Logical size of the file already synced to disk
+     uint64_t batches = 0;  ///< Number of write+sync batches performed
+     bool stopping = false;  ///< Set to make the worker exit once the queue is empty
+     string error;  ///< Why a write or sync failed; empty while everything succeeded
+ 
+     /**
+      * @brief Writes a batch and forces it to stable storage.
+      * @param batch The bytes to append.
+      * @return true if the write, flush and sync all succeeded, false otherwise.
+      */
+     bool writeAndSync(const string& batch) {
+         if (fwrite(batch.data(), 1, batch.size(), file) != batch.size() || fflush(file) != 0) return false;
+ #ifdef _WIN32
+         return _commit(_fileno(file)) == 0;
+ #else
+         return fsync(fileno(file)) == 0;
+ #endif
+     }
+ 
+     /**
+      * @brief Worker loop: writes and syncs everything queued, one batch at a time.
+      */
+     void run() {
+         unique_lock<mutex> guard(lock);
+         while (true) {
+             wake.wait(guard, [this] { return stopping || !queued.empty(); });
+             if (queued.empty()) return;
+ 
+             string batch;
+             batch.swap(queued);
+             uint64_t end = queuedEnd;
+             if (!error.empty()) continue;  // The file is in an unknown state; nothing more is written
+             guard.unlock();
+             bool written = writeAndSync(batch);
+             int code = errno;
+             guard.lock();
+ 
+             if (written) {
+                 durableEnd = end;
+                 batches++;
+             } else {
+                 error = "Could not write to " + path + ": " + strerror(code);
+             }
+             synced.notify_all();
+         }
+     }
+ 
+ public:
+     /**
+      * @brief Opens a file for appending and starts the writer thread.
+      * @param path The file to append to.
+      * @param size The current size of the file.
+      * @return true if the file was opened, false otherwise.
+      */
+     bool open(const string& path, uint64_t size) {
+         file = fopen(path.c_str(), "ab");
+         if (!file) return false;
+         this->path = path;
+         queuedEnd = durableEnd = size;
+         stopping = false;
+         error.clear();
+         worker = thread(&AsyncLogWriter::run, this);
+         return true;
+     }
+ 
+     /**
+      * @brief Checks if the writer is running.
+      * @return true if open() succeeded and close() was not called yet.
+      */
+     bool isOpen() const { return file != nullptr; }
+ 
+     /**
+      * @brief Queues bytes to be appended without waiting for the disk.
+      * @param data The bytes to append.
+      * @return The logical offset at which the data will be written.
+      * @throws runtime_error If an earlier write or sync failed.
+      */
+     uint64_t append(const string& data) {
+         lock_guard<mutex> guard(lock);
+         if (!error.empty()) throw runtime_error(error);
+         uint64_t offset = queuedEnd;
+         queued += data;
+         queuedEnd += data.size();
+         wake.notify_one();
+         return offset;
+     }
+ 
+     /**
+      * @brief Returns the logical size of the file that is already on disk.
+      * @return The number of durable bytes.
+      */
+     uint64_t durable() {
+         lock_guard<mutex> guard(lock);
+         return durableEnd;
+     }
+ 
+     /**
+      * @brief Blocks until the file is durable up to a given size.
+      * @param end The logical size to wait for.
+      * @throws runtime_error If writing or syncing that data failed.
+      */
+     void waitDurable(uint64_t end) {
+         unique_lock<mutex> guard(lock);
+         synced.wait(guard, [this, end] { return durableEnd >= end || !error.empty(); });
+         if (durableEnd < end) throw runtime_error(error);
+     }
+ 
+     /**
+      * @brief Returns the number of batches written so far.
+      * @return The number of write+sync batches.
+      */
+     uint64_t batchCount() {
+         lock_guard<mutex> guard(lock);
+         return batches;
+     }
+ 
+     /**
+      * @brief Writes everything still queued, stops the writer thread and closes the file.
+      */
+     void close() {
+         if (!file) return;
+         {
+             lock_guard<mutex> guard(lock);
+             stopping = true;
+             wake.notify_one();
+         }
+         worker.join();
+         fclose(file);
+         file = nullptr;
+     }
+ 
+     /**
+      * @brief Destructor: flushes pending appends before the program exits.
+      */
+     ~AsyncLogWriter() { close(); }
+ };
+ 
+ /**
+  * @class FailureTracker
+  * @brief Counts failed logins per user and locks accounts out with exponential backoff.
+  * @details Each user's state is one 64-bit atomic word: the failure count in the top 16 bits
+  *          and the end of the lockout, in seconds since the epoch, in the low 48 bits, so it
+  *          is read and updated without locks. A locked-out attempt is refused before any
+  *          hashing. The states are written to a file lazily by a background thread, at most
+  *          every few seconds and only when something changed.
+  */
+ class FailureTracker {
+ public:
+     static constexpr uint32_t threshold = 5;  ///< Failures allowed before the first lockout
+     static constexpr uint64_t maxLockoutSeconds = 15 * 60;  ///< Longest lockout
+ 
+ private:
+     static constexpr uint64_t untilMask = (uint64_t(1) << 48) - 1;  ///< Low 48 bits: lockout end
+     static constexpr size_t shardCount = 64;  ///< Number of shards, a power of two
+ 
+     /**
+      * @brief A group of user states behind one lock; the states themselves are atomics.
+      */
+     struct alignas(64) Shard {
+         mutex lock;  ///< Protects 'states' (not the words it points to)
+         unordered_map<string, unique_ptr<atomic<uint64_t>>> states;  ///< Username to packed state
+     };
+ 
+     Shard shards[shardCount];  ///< User states
+     atomic<bool> dirty;  ///< Set when a state changed since the last write
+     string path;  ///< Where states are persisted; empty to keep them in memory only
+     thread flusher;  ///< Writes the states in the background
+     mutex flushLock;  ///< Protects 'stopping'
+     condition_variable wake;  ///< Wakes the flusher early to stop
+     bool stopping = false;  ///< Set to make the flusher exit
+ 
+     /**
+      * @brief Returns the current time in seconds since the Unix epoch.
+      */
+     static uint64_t now() {
+         return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+     }
+ 
+     /**
+      * @brief Finds a user's state word.
+      * @param create true to add a cleared state if the user has none.
+      * @return The state, or nullptr if the user has none and 'create' is false.
+      */
+     atomic<uint64_t>* find(const string& username, bool create) {
+         Shard& shard = shards[hash<string>()(username) & (shardCount - 1)];
+         lock_guard<mutex> guard(shard.lock);
+         auto it = shard.states.find(username);
+         if (it != shard.states.end()) return it->second.get();
+         if (!create) return nullptr;
+         auto& state = shard.states[username];
+         state.reset(new atomic<uint64_t>(0));
+         return state.get();
+     }
+ 
+     /**
+      * @brief Writes every non-cleared state to the file, replacing it.
+      */
+     void write() {
+         if (path.empty() || !dirty.exchange(false)) return;
+         string temporary = path + ".tmp";
+         {
+             ofstream file(temporary, ios::trunc);
+             for (Shard& shard : shards) {
+                 lock_guard<mutex> guard(shard.lock);
+                 for (const auto& [username, state] : shard.states) {
+                     uint64_t value = state->load(memory_order_relaxed);
+                     if (value) file << username << "," << (value >> 48) << "," << (value & untilMask) << "\n";
+                 }
+             }
+             if (!file) {
+                 dirty = true;  // Try again on the next round
+                 return;
+             }
+         }
+         remove(path.c_str());  // rename() does not replace files on Windows
+         rename(temporary.c_str(), path.c_str());
+     }
+ 
+     /**
+      * @brief Flusher loop: writes the states every few seconds until close() is called.
+      */
+     void run() {
+         unique_lock<mutex> guard(flushLock);
+         while (!stopping) {
+             wake.wait_for(guard, chrono::seconds(5), [this] { return stopping; });
+             guard.unlock();
+             write();
+             guard.lock();
+         }
+     }
+ 
+ public:
+     FailureTracker() : dirty(false) {}
+ 
+     /**
+      * @brief Loads the states saved in a file and starts persisting to it.
+      * @param file The state file; it is created on the first change.
+      */
+     void open(const string& file) {
+         ifstream in(file);
+         string line;
+         while (getline(in, line)) {
+             size_t pos1 = line.find(','), pos2 = line.rfind(',');
+             if (pos1 == string::npos || pos2 == pos1) continue;
+             try {
+                 uint64_t failures = min<uint64_t>(stoull(line.substr(pos1 + 1, pos2 - pos1 - 1)), 0xFFFF);
+                 uint64_t until = stoull(line.substr(pos2 + 1)) & untilMask;
+                 find(line.substr(0, pos1), true)->store(failures << 48 | until);
+             } catch (...) {
+                 // Skip damaged lines; the user simply starts with a clean state
+             }
+         }
+         path = file;
+         flusher = thread(&FailureTracker::run, this);
+     }
+ 
+     /**
+      * @brief Returns how long a user is still locked out.
+      * @param username The user.
+      * @return The remaining lockout in seconds; 0 if the user may try now.
+      */
+     uint64_t lockedFor(const string& username) {
+         atomic<uint64_t>* state = find(username, false);
+         if (!state) return 0;
+         uint64_t until = state->load(memory_order_relaxed) & untilMask, current = now();
+         return until > current ? until - current : 0;
+     }
+ 
+     /**
+      * @brief Records a failed login; from the threshold on, each failure doubles the lockout.
+      * @param username The user.
+      */
+     void recordFailure(const string& username) {
+         atomic<uint64_t>* state = find(username, true);
+         uint64_t value = state->load(memory_order_relaxed), updated;
+         do {
+             uint64_t failures = min<uint64_t>((value >> 48) + 1, 0xFFFF);
+             uint64_t until = value & untilMask;
+             if (failures >= threshold) {
+                 uint64_t doublings = min<uint64_t>(failures - threshold, 10);
+                 until = now() + min<uint64_t>(uint64_t(1) << doublings, maxLockoutSeconds);
+             }
+             updated = failures << 48 | until;
+         } while (!state->compare_exchange_weak(value, updated, memory_order_relaxed));
+         dirty = true;
+     }
+ 
+     /**
+      * @brief Records a successful login, clearing the user's failures.
+      * @param username The user.
+      */
+     void recordSuccess(const string& username) {
+         atomic<uint64_t>* state = find(username, false);
+         if (state && state->exchange(0, memory_order_relaxed) != 0) dirty = true;
+     }
+ 
+     /**
+      * @brief Writes pending changes and stops the flusher.
+      */
+     void close() {
+         if (!flusher.joinable()) return;
+         {
+             lock_guard<mutex> guard(flushLock);
+             stopping = true;
+         }
+         wake.notify_one();
+         flusher.join();
+         write();
+     }
+ 
+     /**
+      * @brief Destructor: writes pending changes before the program exits.
+      */
+     ~FailureTracker() { close(); }
+ };
+ 
+ /**
+  * @class Database
+  * @brief Provides static methods to interact with a database of users.
+  * @details 'users.txt' is an append-only log of "username,hash,salt" lines where the last line
+  *          for a username wins. Only the offset of each user's latest line is kept in memory;
+  *          recently used records live in an LRU cache bounded by a memory budget and the rest
+  *          are read back from disk on demand. A follower process tails another process's
+  *          log instead and serves read-only logins from it. Service accounts authenticate with
+  *          API keys kept in 'apikeys.txt' next to the users, and failed logins are counted in
+  *          'failures.txt'.
+  */
+ class Database {
+ public:
+     /**
+      * @brief How far a follower is behind the log it replicates.
+      */
+     struct ReplicationLag {
+         uint64_t bytesBehind = 0;  ///< Bytes written by the leader but not applied yet
+         double secondsBehind = 0;  ///< Time since the follower was last fully caught up
+     };
+ 
+     /**
+      * @brief Counters describing the behaviour of the credential cache.
+      */
+     struct CacheStats {
+         uint64_t hits = 0;  ///< Lookups answered from memory
+         uint64_t misses = 0;  ///< Lookups that had to read the record from disk
+         uint64_t evictions = 0;  ///< Records dropped to stay within the memory budget
+         size_t entries = 0;  ///< Records currently cached
+         size_t bytes = 0;  ///< Approximate memory used by cached records
+     };
+ 
+     /**
+      * @brief Outcome of a login made through verifyAsync() or verifyBatch().
+      */
+     enum class LoginResult {
+         Accepted,  ///< The password matches
+         Rejected,  ///< Unknown user or wrong password
+         LockedOut,  ///< Refused without hashing: locked after too many failed logins
+         ChallengeRequired,  ///< Refused without hashing: overloaded and no valid proof of work given
+         Throttled,  ///< Refused without hashing: over the per-user or global rate limit
+         Busy  ///< Could not be hashed in time (e.g. the hashing queue timed out); not a failed login
+     };
+ 
+ private:
+     /**
+      * @brief A cached credential record.
+      */
+     struct CacheEntry {
+         string username;  ///< The username of the record
+         Credential credential;  ///< The stored credential
+     };
+ 
+     static const size_t entryOverhead = 160;  ///< Approximate bookkeeping bytes per cached record
+     static map<string, streamoff> offsets;  ///< Offset of each user's latest record in the file
+     static list<CacheEntry> recent;  ///< Cached records, most recently used first
+     static unordered_map<string, list<CacheEntry>::iterator> cache;  ///< Username to cached record
+     static size_t cacheBudget;  ///< Maximum number of bytes used by cached records
+     static CacheStats stats;  ///< Cache counters
+     static streamoff fileSize;  ///< Current end of the append log
+     static ifstream reader;  ///< Reads cold records back from the file
+     static AsyncLogWriter writer;  ///< Appends new records in the background
+     static FailureTracker failures;  ///< Failed logins and lockouts per user
+     static const string failuresFile;  ///< Where 'failures' is persisted
+     static string filename;  ///< The filename to save/load user data
+     static CredentialSnapshot snapshot;  ///< Read-only snapshot served in replica mode
+     static bool fromSnapshot;  ///< true when credentials are served from a snapshot
+     static bool readOnly;  ///< true when new users cannot be added (snapshot or follower)
+     static recursive_mutex lock;  ///< Protects the index and cache from the follower thread
+     static thread follower;  ///< Applies the leader's log in follower mode
+     static atomic<bool> following;  ///< Keeps the follower thread running
+     static uint64_t leaderEnd;  ///< Size of the leader's log at the last poll
+     static chrono::steady_clock::time_point caughtUpAt;  ///< Last time the follower had applied everything
+ 
+     /**
+      * @brief A stored API key: only a keyed digest of its secret part is kept.
+      */
+     struct ApiKey {
+         string username;  ///< The account the key signs in as
+         unsigned char digest[crypto_generichash_BYTES];  ///< Keyed BLAKE2b of the prefix and secret
+     };
+ 
+     static const size_t apiKeyPrefixBytes = 6;  ///< Random bytes in the public key prefix
+     static const size_t apiKeySecretBytes = 32;  ///< Random bytes in the secret part of a key
+     static unordered_map<string, ApiKey> apiKeys;  ///< API keys by prefix
+     static bool apiKeysLoaded;  ///< true once 'apikeys.txt' has been read
+     static const string apiKeyFile;  ///< "prefix,username,digest" lines; an empty username revokes
+     static const string apiKeyPepperFile;  ///< The BLAKE2b key of the digests; keep it private
+ 
+     /**
+      * @brief Splits a "username,hash,salt" line into its fields.
+      * @return true if the line is a valid record, false otherwise.
+      */
+     static bool parseRecord(string line, string& username, string& hash, string& salt) {
+         if (!line.empty() && line.back() == '\r') line.pop_back();  // Files written in text mode on Windows
+         // Encoded hashes contain commas, so the salt is whatever follows the last comma
+         size_t pos1 = line.find(','), pos2 = line.rfind(',');
+         if (pos1 == string::npos || pos2 == pos1) return false;
+         username = line.substr(0, pos1);
+         hash = line.substr(pos1 + 1, pos2 - pos1 - 1);
+         salt = line.substr(pos2 + 1);
+         return true;
+     }
+ 
+     /**
+      * @brief Blocks until the log is on disk up to a given size.
+      * @details Must be called without holding 'lock', so logins and registrations are not
+      *          stalled behind a disk sync.
+      * @param end The logical size of the log to wait for.
+      * @return true if that part of the log can be read back, false if its batch failed to write.
+      */
+     static bool waitReadable(uint64_t end) {
+         try {
+             writer.waitDurable(end);
+             return true;
+         } catch (const runtime_error&) {
+             return false;
+         }
+     }
+ 
+     /**
+      * @brief Reads the record stored at a given offset of the file.
+      * @details The record must already be on disk (see waitReadable()).
+      * @return true if a valid record was read, false otherwise.
+      */
+     static bool readRecord(streamoff offset, string& username, Credential& credential) {
+         if (!reader.is_open()) reader.open(filename, ios::binary);
+         reader.clear();
+         reader.seekg(offset);
+         string line, hash, salt;
+         return getline(reader, line) && parseRecord(line, username, hash, salt) &&
+                Credential::parse(hash, salt, credential);
+     }
+ 
+     /**
+      * @brief Returns the approximate number of bytes a cached record uses.
+      */
+     static size_t entryCost(const CacheEntry& entry) {
+         return entry.username.size() + sizeof entry.credential + entryOverhead;
+     }
+ 
+     /**
+      * @brief Drops least recently used records until the cache fits its budget.
+      */
+     static void evict() {
+         while (stats.bytes > cacheBudget && !recent.empty()) {
+             stats.bytes -= entryCost(recent.back());
+             cache.erase(recent.back().username);
+             recent.pop_back();
+             stats.evictions++;
+         }
+         stats.entries = recent.size();
+     }
+ 
+     /**
+      * @brief Drops a user's record from the cache, if it is cached.
+      */
+     static void uncache(const string& username) {
+         auto it = cache.find(username);
+         if (it == cache.end()) return;
+         stats.bytes -= entryCost(*it->second);
+         recent.erase(it->second);
+         cache.erase(it);
+         stats.entries = recent.size();
+     }
+ 
+     /**
+      * @brief Applies the complete lines appended to the leader's log since the last poll.
+      */
+     static void applyLog() {
+         lock_guard<recursive_mutex> guard(lock);
+         ifstream file(filename, ios::binary);
+         if (!file) return;
+         file.seekg(0, ios::end);
+         leaderEnd = file.tellg();
+         file.seekg(fileSize);
+ 
+         string line, username, hash, salt;
+         streamoff offset = fileSize;
+         while (getline(file, line) && !file.eof()) {  // A line without '\n' is still being written
+             if (parseRecord(line, username, hash, salt)) {
+                 offsets[username] = offset;
+                 uncache(username);  // The user's record may have been replaced
+             }
+             offset = file.tellg();
+         }
+         fileSize = offset;
+         if (uint64_t(fileSize) >= leaderEnd) caughtUpAt = chrono::steady_clock::now();
+     }
+ 
+     /**
+      * @brief Follower loop: polls the leader's log until close() is called.
+      */
+     static void followLoop() {
+         while (following) {
+             applyLog();
+             this_thread::sleep_for(chrono::milliseconds(100));
+         }
+     }
+ 
+     /**
+      * @brief Creates a file readable only by its owner and writes 'size' bytes to it.
+      * @return 1 if the file was written, 0 if it already exists, -1 on any other error.
+      */
+     static int createPrivateFile(const string& path, const unsigned char* data, size_t size) {
+ #ifdef _WIN32
+         int fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+         if (fd < 0) return errno == EEXIST ? 0 : -1;
+         bool written = _write(fd, data, unsigned(size)) == int(size) && _commit(fd) == 0;
+         written = _close(fd) == 0 && written;
+ #else
+         int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+         if (fd < 0) return errno == EEXIST ? 0 : -1;
+         bool written = ::write(fd, data, size) == ssize_t(size) && fsync(fd) == 0;
+         written = ::close(fd) == 0 && written;
+ #endif
+         if (written) return 1;
+         remove(path.c_str());  // A partial key must not be picked up later
+         return -1;
+     }
+ 
+     /**
+      * @brief Returns the BLAKE2b key used for API key digests, creating it if there is none yet.
+      * @details Every issued key depends on this file, so an existing file that cannot be read
+      *          or has the wrong size is an error rather than a reason to make a new key.
+      * @throws runtime_error If the file cannot be created, read or is damaged.
+      */
+     static const array<unsigned char, crypto_generichash_KEYBYTES>& apiKeyPepper() {
+         static const auto pepper = [] {  // Retried on the next call if this throws
+             array<unsigned char, crypto_generichash_KEYBYTES> key;
+             crypto_generichash_keygen(key.data());
+             int created = createPrivateFile(apiKeyPepperFile, key.data(), key.size());
+             if (created < 0) throw runtime_error("Could not create " + apiKeyPepperFile + ": " + strerror(errno));
+             if (created > 0) return key;
+ 
+             ifstream in(apiKeyPepperFile, ios::binary);
+             if (!in.read(reinterpret_cast<char*>(key.data()), key.size()) || in.peek() != char_traits<char>::eof())
+                 throw runtime_error(apiKeyPepperFile + " is unreadable or damaged; API keys cannot be checked");
+             return key;
+         }();
+         return pepper;
+     }
+ 
+     /**
+      * @brief Computes the stored digest of an API key from its prefix and secret.
+      */
+     static void apiKeyDigest(const string& prefix, const unsigned char* secret, unsigned char* digest) {
+         crypto_generichash_state state;
+         crypto_generichash_init(&state, apiKeyPepper().data(), crypto_generichash_KEYBYTES, crypto_generichash_BYTES);
+         crypto_generichash_update(&state, reinterpret_cast<const unsigned char*>(prefix.data()), prefix.size());
+         crypto_generichash_update(&state, secret, apiKeySecretBytes);
+         crypto_generichash_final(&state, digest, crypto_generichash_BYTES);
+     }
+ 
+     /**
+      * @brief Reads 'apikeys.txt' the first time API keys are used.
+      */
+     static void loadApiKeys() {
+         if (apiKeysLoaded) return;
+         apiKeysLoaded = true;
+         ifstream file(apiKeyFile);
+         string line;
+         while (getline(file, line)) {
+             if (!line.empty() && line.back() == '\r') line.pop_back();
+             size_t pos1 = line.find(','), pos2 = line.rfind(',');
+             if (pos1 == string::npos || pos2 == pos1) continue;
+             string prefix = line.substr(0, pos1), username = line.substr(pos1 + 1, pos2 - pos1 - 1);
+             string digestHex = line.substr(pos2 + 1);
+             ApiKey key{username, {}};
+             if (username.empty()) apiKeys.erase(prefix);  // Revoked
+             else if (digestHex.size() == 2 * sizeof key.digest &&
+                      HexCodec::decode(digestHex.data(), digestHex.size(), key.digest))
+                 apiKeys[prefix] = key;
+         }
+     }
+ 
+     /**
+      * @brief Appends a line to 'apikeys.txt'.
+      */
+     static bool appendApiKeyLine(const string& line) {
+         ofstream file(apiKeyFile, ios::app);
+         file << line << "\n";
+         file.flush();
+         return bool(file);
+     }
+ 
+     /**
+      * @brief Inserts or refreshes a record as the most recently used one.
+      */
+     static void cacheRecord(const string& username, const Credential& credential) {
+         uncache(username);
+         if (cacheBudget == 0) return;
+ 
+         recent.push_front({username, credential});
+         cache[username] = recent.begin();
+         stats.bytes += entryCost(recent.front());
+         evict();
+     }
+ 
+ public:
+     /**
+      * @brief Indexes the records of the file; the records themselves stay on disk.
+      */
+     static void loadUsers() {
+         lock_guard<recursive_mutex> guard(lock);
+         ifstream file(filename, ios::binary);
+         if (!file) return;
+ 
+         string line, username, hash, salt;
+         streamoff offset = file.tellg();
+         while (getline(file, line)) {
+             if (parseRecord(line, username, hash, salt)) offsets[username] = offset;
+             offset = file.tellg();
+         }
+         file.clear();
+         file.seekg(0, ios::end);
+         fileSize = file.tellg();
+     }
+ 
+     /**
+      * @brief Loads the failed-login counters and keeps them persisted; leader only.
+      */
+     static void trackFailures() { failures.open(failuresFile); }
+ 
+     /**
+      * @brief Queues a record for appending; it supersedes earlier records of the same user.
+      * @details The write and sync happen on the background writer, so this never blocks on disk.
+      * @param username The username of the record.
+      * @param credential The credential to store.
+      * @throws runtime_error If an earlier write to 'users.txt' failed.
+      */
+     static void appendRecord(const string& username, const Credential& credential) {
+         lock_guard<recursive_mutex> guard(lock);
+         if (!writer.isOpen()) writer.open(filename, fileSize);
+         string line = username + "," + credential.hashText() + "," + credential.saltText() + "\n";
+         offsets[username] = writer.append(line);
+         fileSize += line.size();
+     }
+ 
+     /**
+      * @brief Writes all queued records to disk and stops the background threads.
+      */
+     static void close() {
+         if (following.exchange(false)) follower.join();
+         writer.close();
+         failures.close();
+     }
+ 
+     /**
+      * @brief Returns how long a user is locked out after repeated failed logins.
+      * @param username The user.
+      * @return The remaining lockout in seconds; 0 if the user may try now.
+      */
+     static uint64_t lockedFor(const string& username) { return failures.lockedFor(username); }
+ 
+     /**
+      * @brief Decides if an attempt has done the proof of work the current load calls for.
+      * @param username The username being tried.
+      * @param challenge The challenge issued for this attempt, or empty if none was.
+      * @param solution The client's solution.
+      * @return true if no challenge is needed or the given one is validly solved.
+      */
+     static bool admitProof(const string& username, const string& challenge, uint64_t solution) {
+         if (challenge.empty()) return ProofOfWork::difficulty() == 0;
+         return ProofOfWork::verify(challenge, username, solution);
+     }
+ 
+     /**
+      * @brief Records the outcome of a verified login attempt.
+      * @details A successful login also upgrades a record with an outdated cost, while the
+      *          password is known.
+      * @param username The user.
+      * @param password The password that was verified.
+      * @param credential The stored credential it was verified against.
+      * @param succeeded true if the password matched, false otherwise.
+      */
+     static void recordLogin(const string& username, const string& password, const Credential& credential,
+                             bool succeeded) {
+         if (!succeeded) {
+             failures.recordFailure(username);
+             return;
+         }
+         failures.recordSuccess(username);
+         if (PasswordHasher::needsRehash(credential)) rehashInBackground(username, password);
+     }
+ 
+     /**
+      * @brief Serves read-only logins from another process's log, applying it as it grows.
+      * @param path The leader's 'users.txt'.
+      */
+     static void follow(const string& path) {
+         filename = path;
+         readOnly = true;
+         caughtUpAt = chrono::steady_clock::now();
+         applyLog();
+         following = true;
+         follower = thread(followLoop);
+     }
+ 
+     /**
+      * @brief Checks if the database follows another process's log.
+      * @return true in follower mode, false otherwise.
+      */
+     static bool isFollower() { return following; }
+ 
+     /**
+      * @brief Returns how far the follower is behind the leader's log.
+      * @return The replication lag in bytes and seconds.
+      */
+     static ReplicationLag replicationLag() {
+         lock_guard<recursive_mutex> guard(lock);
+         ReplicationLag lag;
+         lag.bytesBehind = leaderEnd > uint64_t(fileSize) ? leaderEnd - fileSize : 0;
+         if (lag.bytesBehind)
+             lag.secondsBehind = chrono::duration<double>(chrono::steady_clock::now() - caughtUpAt).count();
+         return lag;
+     }
+ 
+     /**
+      * @brief Sets the memory budget of the credential cache.
+      * @param bytes The maximum number of bytes used by cached records; 0 disables caching.
+      */
+     static void setCacheBudget(size_t bytes) {
+         lock_guard<recursive_mutex> guard(lock);
+         cacheBudget = bytes;
+         evict();
+     }
+ 
+     /**
+      * @brief Returns the credential cache counters.
+      * @return The hit, miss and eviction counters and the current cache size.
+      */
+     static CacheStats cacheStats() {
+         lock_guard<recursive_mutex> guard(lock);
+         return stats;
+     }
+ 
+     /**
+      * @brief Writes the current users to a front-coded snapshot file.
+      * @param path The snapshot file to create.
+      * @return true if the snapshot was written successfully, false otherwise.
+      */
+     static bool saveSnapshot(const string& path) {
+         unique_lock<recursive_mutex> guard(lock);
+         // Wait for queued records outside the lock; retry if more were added meanwhile
+         while (writer.isOpen()) {
+             streamoff end = fileSize;
+             guard.unlock();
+             if (!waitReadable(end)) return false;
+             guard.lock();
+             if (fileSize == end) break;
+         }
+         map<string, Credential> users;
+         string username;
+         Credential credential;
+         for (const auto& [user, offset] : offsets)
+             if (readRecord(offset, username, credential)) users[user] = credential;
+         return CredentialSnapshot::write(path, users);
+     }
+ 
+     /**
+      * @brief Serves credentials from a snapshot file instead of 'users.txt'.
+      * @param path The snapshot file to load.
+      * @return true if the snapshot was loaded successfully, false otherwise.
+      */
+     static bool openSnapshot(const string& path) {
+         if (!snapshot.open(path)) return false;
+         fromSnapshot = readOnly = true;
+         return true;
+     }
+ 
+     /**
+      * @brief Checks if the database only serves a read-only snapshot.
+      * @return true if new users cannot be added, false otherwise.
+      */
+     static bool isReadOnly() { return readOnly; }
+ 
+     /**
+      * @brief Checks if a user exists.
+      * @param username The username to check.
+      * @return true if the user exists, false otherwise.
+      */
+     static bool userExists(const string& username) {
+         lock_guard<recursive_mutex> guard(lock);
+         if (fromSnapshot) return snapshot.contains(username);
+         return offsets.find(username) != offsets.end();
+     }
+ 
+     /**
+      * @brief Adds a new user with the provided credentials.
+      * @param username The username of the new user.
+      * @param credential The credential of the new user.
+      * @return true if the user is added successfully, false otherwise.
+      * @throws runtime_error If an earlier write to 'users.txt' failed.
+      */
+     static bool addUser(const string& username, const Credential& credential) {
+         lock_guard<recursive_mutex> guard(lock);
+         if (readOnly || userExists(username)) return false;
+         appendRecord(username, credential);
+         cacheRecord(username, credential);
+         return true;
+     }
+ 
+     /**
+      * @brief Blocks until a user's latest record is on disk.
+      * @param username The user whose record was just added or replaced.
+      * @throws runtime_error If writing or syncing the record failed.
+      */
+     static void waitPersisted(const string& username) {
+         uint64_t end;
+         {
+             lock_guard<recursive_mutex> guard(lock);
+             auto it = offsets.find(username);
+             if (it == offsets.end() || !writer.isOpen()) return;
+             end = it->second + 1;
+         }
+         writer.waitDurable(end);
+     }
+ 
+     /**
+      * @brief Replaces the credentials of an existing user.
+      * @param username The username of the user.
+      * @param credential The new credential.
+      * @return true if the record was replaced, false otherwise.
+      * @throws runtime_error If an earlier write to 'users.txt' failed.
+      */
+     static bool updateUser(const string& username, const Credential& credential) {
+         lock_guard<recursive_mutex> guard(lock);
+         if (readOnly || offsets.find(username) == offsets.end()) return false;
+         appendRecord(username, credential);
+         cacheRecord(username, credential);
+         return true;
+     }
+ 
+     /**
+      * @brief Rehashes a user's password with the current cost on the hashing pool.
+      * @details Called after a successful login, when the password is known, so the record can
+      *          move to the current algorithm and cost without a migration outage.
+      * @param username The username of the user.
+      * @param password The password that was just verified.
+      */
+     static void rehashInBackground(const string& username, const string& password) {
+         if (readOnly) return;
+         PasswordHasher::pool().submit([username, secret = password]() mutable {
+             try {
+                 updateUser(username, PasswordHasher::hashPassword(secret));
+             } catch (...) {
+                 // The old record stays valid; the upgrade is retried on the next login
+             }
+             sodium_memzero(&secret[0], secret.size());
+         });
+     }
+ 
+     /**
+      * @brief Verifies many (username, password) pairs at once.
+      * @details All records are looked up first; the hashing is then fanned out across the
+      *          hashing pool. Unknown, locked-out and rate-limited attempts are answered without
+      *          being hashed, and each attempt is charged to the rate limiters on its own, so a
+      *          gateway can retry the Throttled entries later. An attempt that could not be
+      *          hashed is Busy and is not counted as a failed login.
+      * @param attempts The (username, password) pairs to verify.
+      * @return The results, in the same order as 'attempts'.
+      */
+     static vector<LoginResult> verifyBatch(const vector<pair<string, string>>& attempts) {
+         vector<LoginResult> results(attempts.size(), LoginResult::Rejected);
+         vector<PasswordHasher::VerifyJob> jobs;
+         vector<size_t> positions;
+         for (size_t i = 0; i < attempts.size(); i++) {
+             PasswordHasher::VerifyJob job;
+             if (!getCredentials(attempts[i].first, job.credential)) continue;
+             if (lockedFor(attempts[i].first)) {
+                 results[i] = LoginResult::LockedOut;
+                 continue;
+             }
+             if (!PasswordHasher::admitAttempt(attempts[i].first, attempts[i].second, job.credential)) {
+                 results[i] = LoginResult::Throttled;
+                 continue;
+             }
+             job.password = attempts[i].second;
+             jobs.push_back(move(job));
+             positions.push_back(i);
+         }
+ 
+         vector<future<bool>> pending;
+         pending.reserve(jobs.size());
+         for (const auto& job : jobs) pending.push_back(PasswordHasher::verifyPasswordAsync(job.password, job.credential));
+ 
+         for (size_t j = 0; j < positions.size(); j++) {
+             bool verified;
+             try {
+                 verified = pending[j].get();
+             } catch (const runtime_error&) {
+                 results[positions[j]] = LoginResult::Busy;  // Overload is not a wrong password
+                 continue;
+             }
+             recordLogin(attempts[positions[j]].first, jobs[j].password, jobs[j].credential, verified);
+             if (verified) results[positions[j]] = LoginResult::Accepted;
+         }
+         return results;
+     }
+ 
+     /**
+      * @brief Verifies a user's password without blocking the caller.
+      * @param username The username to verify.
+      * @param password The password to verify.
+      * @param challenge The proof-of-work challenge from ProofOfWork::challengeFor(), if one was issued.
+      * @param solution The client's solution to that challenge.
+      * @return A future holding the outcome. Refusals (lockout, missing proof of work, rate
+      *         limits) are ready at once and nothing is hashed; an attempt that could not be
+      *         hashed is Busy, as in verifyBatch(), and is not counted as a failed login.
+      */
+     static future<LoginResult> verifyAsync(const string& username, const string& password,
+                                            const string& challenge = "", uint64_t solution = 0) {
+         auto outcome = make_shared<promise<LoginResult>>();
+         future<LoginResult> result = outcome->get_future();
+         Credential credential;
+         if (!getCredentials(username, credential)) {
+             outcome->set_value(LoginResult::Rejected);
+         } else if (lockedFor(username)) {
+             outcome->set_value(LoginResult::LockedOut);
+         } else if (!admitProof(username, challenge, solution)) {
+             outcome->set_value(LoginResult::ChallengeRequired);
+         } else if (!PasswordHasher::admitAttempt(username, password, credential)) {
+             outcome->set_value(LoginResult::Throttled);
+         } else {
+             PasswordHasher::verifyPasswordAsync(password, credential,
+                                                 [username, password, credential, outcome](bool verified,
+                                                                                           exception_ptr error) {
+                 if (error) {
+                     try {
+                         rethrow_exception(error);
+                     } catch (const runtime_error&) {
+                         outcome->set_value(LoginResult::Busy);
+                     } catch (...) {
+                         outcome->set_exception(current_exception());
+                     }
+                     return;
+                 }
+                 recordLogin(username, password, credential, verified);
+                 outcome->set_value(verified ? LoginResult::Accepted : LoginResult::Rejected);
+             });
+         }
+         return result;
+     }
+ 
+     /**
+      * @brief Retrieves the credential of a given username, from the cache or from disk.
+      * @param username The username to retrieve credentials for.
+      * @param credential Receives the stored credential.
+      * @return true if credentials are found, false otherwise.
+      */
+     static bool getCredentials(const string& username, Credential& credential) {
+         unique_lock<recursive_mutex> guard(lock);
+         if (fromSnapshot) return snapshot.getCredentials(username, credential);
+ 
+         streamoff durable = -1;  // Offset already known to be on disk
+         for (;;) {
+             auto cached = cache.find(username);
+             if (cached != cache.end()) {
+                 stats.hits++;
+                 recent.splice(recent.begin(), recent, cached->second);  // Mark as most recently used
+                 credential = cached->second->credential;
+                 return true;
+             }
+ 
+             auto it = offsets.find(username);
+             if (it == offsets.end()) return false;
+             if (!writer.isOpen() || it->second == durable || uint64_t(it->second) < writer.durable()) break;
+             // A record evicted before its batch reached the disk is rare; wait for that batch
+             // only, without the lock, then look again in case the user was updated meanwhile
+             durable = it->second;
+             guard.unlock();
+             if (!waitReadable(durable + 1)) return false;
+             guard.lock();
+         }
+ 
+         stats.misses++;
+         string stored;
+         if (!readRecord(offsets[username], stored, credential) || stored != username) return false;
+         cacheRecord(username, credential);
+         return true;
+     }
+ 
+     /**
+      * @brief Returns the number of users.
+      * @return The number of users.
+      */
+     static int userCount() {
+         lock_guard<recursive_mutex> guard(lock);
+         return fromSnapshot ? snapshot.size() : offsets.size();
+     }
+ 
+     /**
+      * @brief Creates an API key for an existing user.
+      * @details The key is "ak_<prefix>_<secret>": the hex prefix locates the record and the
+      *          256-bit secret is only stored as a keyed BLAKE2b digest, so the key is shown once.
+      * @param username The user the key signs in as.
+      * @return The new key, or an empty string if the user does not exist or the store is read-only.
+      * @throws runtime_error If the digest key in 'apikeys.key' cannot be created or read.
+      */
+     static string createApiKey(const string& username) {
+         lock_guard<recursive_mutex> guard(lock);
+         if (readOnly || !userExists(username)) return "";
+         loadApiKeys();
+ 
+         unsigned char prefixBytes[apiKeyPrefixBytes], secret[apiKeySecretBytes];
+         randombytes_buf(prefixBytes, sizeof prefixBytes);
+         randombytes_buf(secret, sizeof secret);
+         string prefix = HexCodec::encode(prefixBytes, sizeof prefixBytes);
+         ApiKey key{username, {}};
+         apiKeyDigest(prefix, secret, key.digest);
+         if (!appendApiKeyLine(prefix + "," + username + "," + HexCodec::encode(key.digest, sizeof key.digest)))
+             return "";
+         apiKeys[prefix] = key;
+ 
+         const int variant = sodium_base64_VARIANT_URLSAFE_NO_PADDING;
+         char secretText[sodium_base64_ENCODED_LEN(apiKeySecretBytes, variant)];
+         sodium_bin2base64(secretText, sizeof secretText, secret, sizeof secret, variant);
+         sodium_memzero(secret, sizeof secret);
+         return "ak_" + prefix + "_" + secretText;
+     }
+ 
+     /**
+      * @brief Checks an API key and returns the user it signs in as.
+      * @details One hash-map lookup by prefix and one keyed BLAKE2b over 32 bytes, compared in
+      *          constant time; no Argon2, since the secret is already high-entropy.
+      * @param apiKey The key returned by createApiKey().
+      * @param username Receives the user on success.
+      * @return true if the key is valid and not revoked, false otherwise.
+      * @throws runtime_error If the digest key in 'apikeys.key' cannot be read.
+      */
+     static bool verifyApiKey(const string& apiKey, string& username) {
+         const size_t prefixLength = 2 * apiKeyPrefixBytes;
+         if (apiKey.size() < 4 + prefixLength || apiKey.compare(0, 3, "ak_") != 0 || apiKey[3 + prefixLength] != '_')
+             return false;
+         string prefix = apiKey.substr(3, prefixLength);
+         unsigned char secret[apiKeySecretBytes], digest[crypto_generichash_BYTES];
+         size_t length;
+         const char* secretText = apiKey.c_str() + 4 + prefixLength;
+         if (sodium_base642bin(secret, sizeof secret, secretText, apiKey.size() - 4 - prefixLength, nullptr, &length,
+                               nullptr, sodium_base64_VARIANT_URLSAFE_NO_PADDING) != 0 || length != sizeof secret)
+             return false;
+         apiKeyDigest(prefix, secret, digest);
+         sodium_memzero(secret, sizeof secret);
+ 
+         lock_guard<recursive_mutex> guard(lock);
+         loadApiKeys();
+         auto it = apiKeys.find(prefix);
+         if (it == apiKeys.end() || sodium_memcmp(it->second.digest, digest, sizeof digest) != 0) return false;
+         username = it->second.username;
+         return true;
+     }
+ 
+     /**
+      * @brief Revokes an API key.
+      * @param apiKey The key, or just its "ak_<prefix>" part.
+      * @return true if a key was revoked, false otherwise.
+      */
+     static bool revokeApiKey(const string& apiKey) {
+         const size_t prefixLength = 2 * apiKeyPrefixBytes;
+         if (apiKey.size() < 3 + prefixLength || apiKey.compare(0, 3, "ak_") != 0) return false;
+         string prefix = apiKey.substr(3, prefixLength);
+         lock_guard<recursive_mutex> guard(lock);
+         loadApiKeys();
+         if (readOnly || !apiKeys.count(prefix) || !appendApiKeyLine(prefix + ",,")) return false;
+         apiKeys.erase(prefix);
+         return true;
+     }
+ };
+ 
+ map<string, streamoff> Database::offsets;  ///< Static member variable that indexes user records
+ list<Database::CacheEntry> Database::recent;  ///< Static member variable that holds cached records
+ unordered_map<string, list<Database::CacheEntry>::iterator> Database::cache;  ///< Static member variable that finds cached records
+ size_t Database::cacheBudget = 8 * 1024 * 1024;  ///< Static member variable for the cache budget (8 MB by default)
+ Database::CacheStats Database::stats;  ///< Static member variable that holds the cache counters
+ streamoff Database::fileSize = 0;  ///< Static member variable for the end of the append log
+ ifstream Database::reader;  ///< Static member variable for reading cold records
+ AsyncLogWriter Database::writer;  ///< Static member variable for appending records
+ FailureTracker Database::failures;  ///< Static member variable that tracks failed logins
+ const string Database::failuresFile = "failures.txt";  ///< Static constant string for the failed-login file
+ string Database::filename = "users.txt";  ///< Static string for the filename to store user data
+ CredentialSnapshot Database::snapshot;  ///< Static member variable that holds the replica snapshot
+ bool Database::fromSnapshot = false;  ///< Static member variable set when serving a snapshot
+ bool Database::readOnly = false;  ///< Static member variable set when registration is disabled
+ recursive_mutex Database::lock;  ///< Static member variable that guards the index and cache
+ thread Database::follower;  ///< Static member variable for the follower thread
+ atomic<bool> Database::following(false);  ///< Static member variable set in follower mode
+ uint64_t Database::leaderEnd = 0;  ///< Static member variable for the size of the leader's log
+ chrono::steady_clock::time_point Database::caughtUpAt;  ///< Static member variable for the last catch-up time
+ unordered_map<string, Database::ApiKey> Database::apiKeys;  ///< Static member variable that indexes API keys by prefix
+ bool Database::apiKeysLoaded = false;  ///< Static member variable set once the API keys are read
+ const string Database::apiKeyFile = "apikeys.txt";  ///< Static constant string for the API key file
+ const string Database::apiKeyPepperFile = "apikeys.key";  ///< Static constant string for the API key digest secret
+ 
+ /**
+  * @class Benchmark
+  * @brief Provides static methods that measure the performance of the storage and hashing code.
+  */
+ class Benchmark {
+ private:
+     /**
+      * @brief Returns the number of page faults taken by the process so far.
+      */
+     static long long pageFaults() {
+ #ifdef _WIN32
+         PROCESS_MEMORY_COUNTERS counters;
+         GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters);
+         return counters.PageFaultCount;
+ #else
+         rusage usage;
+         getrusage(RUSAGE_SELF, &usage);
+         return usage.ru_minflt + usage.ru_majflt;
+ #endif
+     }
+
+     /**
+      * @brief Returns the seconds elapsed since a given time point.
+      */
+     static double secondsSince(chrono::steady_clock::time_point start) {
+         return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+     }
+ 
+     /**
+      * @brief Generates usernames that share long tenant prefixes, like the real ones do.
+      */
+     static vector<string> makeUsernames(size_t count) {
+         vector<string> names(count);
+         char name[64];
+         for (size_t i = 0; i < count; i++) {
+             snprintf(name, sizeof name, "tenant%02zu-emp%09zu", i % 50, i);
+             names[i] = name;
+         }
+         return names;
+     }
+ 
+ public:
+     /**
+      * @brief Measures build time, size and lookup latency of MinimalPerfectHash.
+      * @param keys The number of usernames to index.
+      */
+     static void perfectHash(size_t keys) {
+         vector<string> names = makeUsernames(keys);
+ 
+         auto start = chrono::steady_clock::now();
+         MinimalPerfectHash mph;
+         mph.build(names);
+         double buildTime = secondsSince(start);
+ 
+         vector<size_t> order(keys);
+         for (size_t i = 0; i < keys; i++) order[i] = (i * 2654435761ULL) % keys;
+         start = chrono::steady_clock::now();
+         uint64_t checksum = 0;
+         for (size_t i : order) checksum += mph.lookup(names[i]);
+         double lookupTime = secondsSince(start);
+ 
+         cout << "Perfect hash over " << keys << " keys\n"
+              << "  build:   " << buildTime << " s\n"
+              << "  size:    " << mph.bitsPerKey() << " bits/key\n"
+              << "  lookup:  " << lookupTime * 1e9 / keys << " ns/key"
+              << " (checksum " << checksum << ")" << endl;
+     }
+ 
+     /**
+      * @brief Compares PasswordHasher::verifyBatch() with verifying the same passwords one by one.
+      * @param count The number of passwords in the batch.
+      */
+     static void batchVerify(size_t count) {
+         vector<PasswordHasher::VerifyJob> jobs(count);
+         for (size_t i = 0; i < count; i++) {
+             jobs[i].password = "Benchmark password " + to_string(i);
+             jobs[i].credential = PasswordHasher::hashPassword(jobs[i].password);
+         }
+ 
+         auto start = chrono::steady_clock::now();
+         size_t sequentialOk = 0;
+         for (const auto& job : jobs) sequentialOk += PasswordHasher::verifyPassword(job.password, job.credential);
+         double sequential = secondsSince(start);
+ 
+         start = chrono::steady_clock::now();
+         vector<bool> results = PasswordHasher::verifyBatch(jobs);
+         double batch = secondsSince(start);
+         size_t batchOk = count_if(results.begin(), results.end(), [](bool ok) { return ok; });
+ 
+         cout << "Verifying " << count << " passwords on " << PasswordHasher::pool().size() << " workers\n"
+              << "  sequential: " << count / sequential << " verifications/s (" << sequentialOk << " ok)\n"
+              << "  batch:      " << count / batch << " verifications/s (" << batchOk << " ok)\n"
+              << "  speedup:    " << sequential / batch << "x" << endl;
+     }
+ 
+     /**
+      * @brief Compares hex encoding and decoding of 32-byte hashes across kernels and modes.
+      * @param count The number of hashes converted per run.
+      */
+     static void hex(size_t count) {
+         const size_t width = 32;
+         vector<unsigned char> bytes(count * width), decoded(count * width);
+         randombytes_buf(bytes.data(), bytes.size());
+         string text(2 * count * width, '\0');
+         char buffer[2 * width + 1];
+         size_t mismatches = 0;
+ 
+         auto start = chrono::steady_clock::now();
+         for (size_t i = 0; i < count; i++) {
+             for (size_t j = 0; j < width; j++) snprintf(&buffer[2 * j], 3, "%02x", bytes[i * width + j]);
+             memcpy(&text[2 * i * width], buffer, 2 * width);
+         }
+         double encodeTime = secondsSince(start);
+         start = chrono::steady_clock::now();
+         for (size_t i = 0; i < count; i++) {
+             string value = text.substr(2 * i * width, 2 * width);
+             for (size_t j = 0; j < width; j++) decoded[i * width + j] = stoi(value.substr(j * 2, 2), nullptr, 16);
+         }
+         double decodeTime = secondsSince(start);
+         cout << "Hex for " << count << " 32-byte hashes, ns per hash (encode / decode)\n"
+              << "  snprintf/stoi        " << encodeTime * 1e9 / count << " / " << decodeTime * 1e9 / count << "\n";
+ 
+         HexCodec::Kernel previous = HexCodec::activeKernel();
+         for (HexCodec::Kernel kernel : HexCodec::supportedKernels()) {
+             HexCodec::setKernel(kernel);
+             for (HexCodec::Mode mode : { HexCodec::Mode::Fast, HexCodec::Mode::ConstantTime }) {
+                 start = chrono::steady_clock::now();
+                 for (size_t i = 0; i < count; i++)
+                     HexCodec::encode(&bytes[i * width], width, &text[2 * i * width], mode);
+                 encodeTime = secondsSince(start);
+                 start = chrono::steady_clock::now();
+                 for (size_t i = 0; i < count; i++)
+                     mismatches += !HexCodec::decode(&text[2 * i * width], 2 * width, &decoded[i * width], mode);
+                 decodeTime = secondsSince(start);
+                 mismatches += decoded != bytes;
+ 
+                 string name = HexCodec::kernelName(kernel) + (mode == HexCodec::Mode::Fast ? "" : " (const)");
+                 cout << "  " << setw(21) << left << name << right
+                      << encodeTime * 1e9 / count << " / " << decodeTime * 1e9 / count << "\n";
+             }
+         }
+         HexCodec::setKernel(previous);
+         cout << "  mismatches: " << mismatches << endl;
+     }
+ 
+     /**
+      * @brief Measures what failed-login tracking adds to a successful login, and what a refusal costs.
+      * @param rounds The number of logins measured in each case.
+      */
+     static void lockouts(size_t rounds) {
+         FailureTracker tracker;  // In memory only
+         vector<string> names = makeUsernames(100000);
+         for (size_t i = 0; i < names.size(); i += 2) tracker.recordFailure(names[i]);  // Half have a state
+ 
+         auto measure = [&](size_t first, auto login) {  // Every other user, starting at 'first'
+             auto start = chrono::steady_clock::now();
+             for (size_t i = 0; i < rounds; i++) login(names[(first + 2 * i) % names.size()]);
+             return secondsSince(start) * 1e9 / rounds;
+         };
+         auto succeed = [&](const string& name) {
+             if (!tracker.lockedFor(name)) tracker.recordSuccess(name);
+         };
+         double clean = measure(1, succeed);
+         double known = measure(0, succeed);
+         size_t refused = 0;
+         const string lockedUser = "locked-user";
+         for (size_t i = 0; i < FailureTracker::threshold + 8; i++) tracker.recordFailure(lockedUser);
+         double locked = measure(0, [&](const string&) { refused += tracker.lockedFor(lockedUser) > 0; });
+ 
+         unsigned char salt[crypto_pwhash_SALTBYTES], tag[32];
+         randombytes_buf(salt, sizeof salt);
+         auto start = chrono::steady_clock::now();
+         crypto_pwhash(tag, sizeof tag, "Benchmark password", 18, salt, crypto_pwhash_OPSLIMIT_MODERATE,
+                       crypto_pwhash_MEMLIMIT_MODERATE, crypto_pwhash_ALG_ARGON2ID13);
+         double argon2 = secondsSince(start) * 1e9;
+ 
+         cout << "Failed-login tracking over " << rounds << " logins, ns per login\n"
+              << "  success, user without failures: " << clean << "\n"
+              << "  success, user with failures:    " << known << "\n"
+              << "  refused while locked out:       " << locked << " (" << refused << " refused)\n"
+              << "  overhead vs one MODERATE hash:  " << 100 * max(clean, known) / argon2 << " %" << endl;
+     }
+ 
+     /**
+      * @brief Measures how long Database::verifyApiKey() takes for a valid and a wrong key.
+      * @param key An existing API key; the wrong key differs from it in the secret part.
+      * @param rounds The number of verifications of each kind.
+      */
+     static void apiKeys(const string& key, size_t rounds) {
+         string wrong = key;
+         wrong[wrong.size() - 2] = wrong[wrong.size() - 2] == 'A' ? 'B' : 'A';
+ 
+         string found;
+         size_t valid = 0;
+         auto start = chrono::steady_clock::now();
+         for (size_t i = 0; i < rounds; i++) valid += Database::verifyApiKey(key, found);
+         double goodTime = secondsSince(start);
+         start = chrono::steady_clock::now();
+         for (size_t i = 0; i < rounds; i++) valid += Database::verifyApiKey(wrong, found);
+         double wrongTime = secondsSince(start);
+ 
+         cout << "API key verification over " << rounds << " rounds\n"
+              << "  valid key: " << goodTime * 1e9 / rounds << " ns\n"
+              << "  wrong key: " << wrongTime * 1e9 / rounds << " ns"
+              << " (" << valid << " accepted)" << endl;
+     }
+ 
+     /**
+      * @brief Measures single-thread hashes per second of every supported Argon2 kernel.
+      * @param rounds The number of hashes per kernel.
+      */
+     static void kernels(size_t rounds) {
+         unsigned char salt[crypto_pwhash_SALTBYTES], tag[32];
+         randombytes_buf(salt, sizeof salt);
+         const uint32_t passes = crypto_pwhash_OPSLIMIT_MODERATE;
+         const uint32_t memoryKiB = crypto_pwhash_MEMLIMIT_MODERATE / 1024;
+         Argon2::Kernel previous = Argon2::activeKernel();
+ 
+         cout << "Argon2id m=" << memoryKiB / 1024 << " MB, t=" << passes << ", p=1, one core\n";
+         for (Argon2::Kernel kernel : Argon2::supportedKernels()) {
+             Argon2::setKernel(kernel);
+             Argon2::hash(tag, sizeof tag, "Benchmark password", salt, sizeof salt, passes, memoryKiB, 1);
+             auto start = chrono::steady_clock::now();
+             for (size_t i = 0; i < rounds; i++)
+                 Argon2::hash(tag, sizeof tag, "Benchmark password", salt, sizeof salt, passes, memoryKiB, 1);
+             double elapsed = secondsSince(start);
+             cout << "  " << setw(10) << left << Argon2::kernelName(kernel) << right
+                  << rounds / elapsed << " hashes/s per core" << endl;
+         }
+         Argon2::setKernel(previous);
+     }
+ 
+     /**
+      * @brief Compares page faults and latency of libsodium and of Argon2 in arena mode.
+      * @param rounds The number of MODERATE hashes per variant.
+      */
+     static void arenas(size_t rounds) {
+         unsigned char salt[crypto_pwhash_SALTBYTES], tag[32];
+         randombytes_buf(salt, sizeof salt);
+         const string password = "Benchmark password";
+         const uint32_t passes = crypto_pwhash_OPSLIMIT_MODERATE;
+         const uint32_t memoryKiB = crypto_pwhash_MEMLIMIT_MODERATE / 1024;
+ 
+         long long faults = pageFaults();
+         auto start = chrono::steady_clock::now();
+         for (size_t i = 0; i < rounds; i++)
+             crypto_pwhash(tag, sizeof tag, password.c_str(), password.size(), salt,
+                           passes, size_t(memoryKiB) * 1024, crypto_pwhash_ALG_ARGON2ID13);
+         double sodiumTime = secondsSince(start);
+         long long sodiumFaults = pageFaults() - faults;
+ 
+         bool previous = Argon2::arenaReuse();
+         Argon2::setArenaLimits(PasswordHasher::admission().getBudget(), size_t(memoryKiB) * 1024);
+         Argon2::setArenaReuse(true);
+         Argon2::hash(tag, sizeof tag, password, salt, sizeof salt, passes, memoryKiB, 1);  // Warms the arena
+         faults = pageFaults();
+         start = chrono::steady_clock::now();
+         for (size_t i = 0; i < rounds; i++)
+             Argon2::hash(tag, sizeof tag, password, salt, sizeof salt, passes, memoryKiB, 1);
+         double arenaTime = secondsSince(start);
+         long long arenaFaults = pageFaults() - faults;
+         Argon2::setArenaReuse(previous);
+ 
+         cout << "Hashing " << rounds << " times with m=" << memoryKiB / 1024 << " MB, t=" << passes << "\n"
+              << "  libsodium: " << sodiumTime * 1000 / rounds << " ms/hash, "
+              << sodiumFaults / double(rounds) << " page faults/hash\n"
+              << "  arena:     " << arenaTime * 1000 / rounds << " ms/hash, "
+              << arenaFaults / double(rounds) << " page faults/hash" << endl;
+     }
+ };
+ 
+ /**
+  * @brief Displays the login screen and verifies user credentials.
+  */
+ void loginScreen() {
+     Terminal::printHeader("User Login");
+     string username, password;
+     cout << "Username: ";
+     getline(cin, username);
+     if (username.empty()) {
+         Terminal::printError("Username required");
+         Terminal::waitForEnter();
+         return;
+     }
+ 
+     password = getPasswordFromUser("Password: ");
+     Credential stored;
+     if (!Database::getCredentials(username, stored)) {
+         Terminal::printError("User not found");
+         Terminal::waitForEnter();
+         return;
+     }
+     if (uint64_t seconds = Database::lockedFor(username)) {
+         Terminal::printError("Account locked after failed logins, try again in " + to_string(seconds) + " s");
+         Terminal::waitForEnter();
+         return;
+     }
+     string challenge = ProofOfWork::challengeFor(username);
+     if (!challenge.empty()) {
+         Terminal::printInfo("Server busy: solving a proof-of-work challenge before the password is hashed");
+         future<uint64_t> solution = async(launch::async, ProofOfWork::solve, challenge, username);
+         if (!Database::admitProof(username, challenge, Terminal::loading("Solving challenge", move(solution)))) {
+             Terminal::printError("Proof-of-work challenge expired, try again");
+             Terminal::waitForEnter();
+             return;
+         }
+     }
+     if (!PasswordHasher::admitAttempt(username, password, stored)) {
+         Terminal::printError("Too many login attempts, try again later");
+         Terminal::waitForEnter();
+         return;
+     }
+ 
+     future<bool> verified = PasswordHasher::verifyPasswordAsync(password, stored);
+     bool succeeded;
+     try {
+         succeeded = Terminal::loading("Securely hashing password", move(verified));
+     } catch (const runtime_error&) {
+         Terminal::printError("The server is busy, please try again in a moment");
+         Terminal::waitForEnter();
+         return;
+     }
+     Database::recordLogin(username, password, stored, succeeded);
+     if (succeeded) {
+         Terminal::printSuccess("Login successful!");
+         cout << TerminalColors::Magenta << "\nWelcome to your secure account, " 
+              << username << "!" << TerminalColors::Reset << endl;
+         cout << "Session token (use \"Resume session\" to sign in again without your password):\n"
+              << SessionTokens::issue(username) << endl;
+     } else {
+         Terminal::printError("Invalid credentials");
+     }
+     Terminal::waitForEnter();
+ }
+ 
+ /**
+  * @brief Displays the session screen and signs the user in with a token from an earlier login.
+  */
+ void sessionScreen() {
+     Terminal::printHeader("Resume Session");
+     string token, username;
+     cout << "Session token: ";
+     getline(cin, token);
+ 
+     chrono::seconds remaining;
+     if (SessionTokens::validate(token, username, remaining) && Database::userExists(username)) {
+         Terminal::printSuccess("Session resumed!");
+         cout << TerminalColors::Magenta << "\nWelcome back, " << username << "! (session valid for "
+              << (remaining.count() + 59) / 60 << " more minutes)" << TerminalColors::Reset << endl;
+     } else {
+         Terminal::printError("Invalid or expired session");
+     }
+     Terminal::waitForEnter();
+ }
+ 
+ /**
+  * @brief Displays the registration screen and prompts the user to create a new account.
+  */
+ void registrationScreen() {
+     Terminal::printHeader("New Account Registration");
+     if (Database::isReadOnly()) {
+         Terminal::printError("Registration is disabled on read-only replicas");
+         Terminal::waitForEnter();
+         return;
+     }
+ 
+     User newUser;
+     string username;
+     cout << "Username: ";
+     getline(cin, username);
+     if (username.empty()) {
+         Terminal::printError("Username required");
+         Terminal::waitForEnter();
+         return;
+     }
+ 
+     for (char c : username) {
+         if (!isalnum(c)) {
+             Terminal::printError("Only alphanumeric characters allowed");
+             Terminal::waitForEnter();
+             return;
+         }
+     }
+ 
+     if (Database::userExists(username)) {
+         Terminal::printError("Username already taken");
+         Terminal::waitForEnter();
+         return;
+     }
+ 
+     newUser.setUsername(username);
+     Terminal::printInfo("Password Requirements:\n"
+         "- Minimum 12 characters\n"
+         "- At least 1 uppercase, 1 lowercase\n"
+         "- At least 1 digit and 1 special character");
+ 
+     bool passwordSet = false;
+     while (!passwordSet) {
+         string pw = getPasswordFromUser("Enter password: ");
+         if (pw.empty()) {
+             Terminal::printError("Password cannot be empty");
+             continue;
+         }
+         passwordSet = newUser.setPassword(pw);
+     }
+ 
+     Credential credential = Terminal::loading("Securely hashing password",
+                                               PasswordHasher::hashPasswordAsync(newUser.getPassword()));
+     try {
+         if (Database::addUser(username, credential)) {
+             Database::waitPersisted(username);
+             Terminal::printSuccess("Account created successfully!");
+         } else {
+             Terminal::printError("Account creation failed");
+         }
+     } catch (const runtime_error& e) {
+         Terminal::printError(string("Account creation failed: ") + e.what());
+     }
+     Terminal::waitForEnter();
+ }
+ 
+ /**
+  * @brief Parses "--name value" and "--flag" command-line arguments.
+  * @param argc The number of command-line arguments.
+  * @param argv The command-line arguments.
+  * @return The options by name, without the leading dashes; flags map to an empty string.
+  */
+ map<string, string> parseOptions(int argc, char* argv[]) {
+     map<string, string> options;
+     for (int i = 1; i < argc; i++) {
+         string name = argv[i];
+         if (name.rfind("--", 0) != 0) continue;
+         bool hasValue = i + 1 < argc && string(argv[i + 1]).rfind("--", 0) != 0;
+         options[name.substr(2)] = hasValue ? argv[++i] : "";
+     }
+     return options;
+ }
+ 
+ /**
+  * @brief Reads a numeric option, printing a usage error if it is malformed or out of range.
+  * @param options The parsed options.
+  * @param name The option name, without the leading dashes.
+  * @param value Receives the number; left unchanged if the option is absent.
+  * @param low The smallest accepted value.
+  * @param high The largest accepted value.
+  * @return true if the option is absent or valid, false otherwise.
+  */
+ template <class T>
+ bool numberOption(const map<string, string>& options, const string& name, T& value, T low, T high) {
+     auto it = options.find(name);
+     if (it == options.end() || parseNumber(it->second, value, low, high)) return true;
+     ostringstream message;
+     message << "--" << name << " expects a number from " << low << " to " << high;
+     Terminal::printError(message.str());
+     return false;
+ }
+ 
+ /**
+  * @brief Main function to run the authentication system.
+  * @details Optional arguments:
+  *          --snapshot <file>    writes a snapshot of 'users.txt' and exits;
+  *          --replica <file>     serves logins read-only from a snapshot;
+  *          --follow <file>      serves logins read-only from another process's 'users.txt';
+  *          --cache-mb <n>       memory budget of the credential cache (default 8);
+  *          --hash-memory-mb <n> memory budget of concurrent password hashes (default 1024);
+  *          --lanes <n>          Argon2 lanes used for new hashes (default 1);
+  *          --arenas             hashes in pre-faulted arenas pooled within the hash memory budget;
+  *          --verified-ttl <s>   remembers successful logins for s seconds (default 0, off);
+  *          --user-rate <n>      login attempts allowed per user per minute (default 10);
+  *          --global-rate <n>    login attempts allowed per second in total (default 2 per core);
+  *          --token-minutes <n>  lifetime of session tokens issued at login (default 15);
+  *          --create-api-key <u> prints a new API key for user u and exits;
+  *          --revoke-api-key <k> revokes an API key and exits;
+  *          --api-key <key>      checks an API key, prints its user and exits (status 1 if invalid);
+  *          --calibrate          picks the Argon2 cost for this machine and saves it;
+  *          --target-ms <n>      p99 latency target of --calibrate (default 500);
+  *          --concurrency <n>    concurrent hashes assumed by --calibrate (default: cores);
+  *          --bench mph          benchmarks the snapshot perfect hash;
+  *          --bench batch        compares batch and sequential password verification;
+  *          --bench lockout      measures the cost of failed-login tracking;
+  *          --bench hex          compares the hex codec kernels with snprintf/stoi;
+  *          --bench apikey       measures verification of the key given with --api-key;
+  *          --bench kernels      measures hashes/s per core of each Argon2 kernel;
+  *          --selftest           checks every Argon2 kernel against known answers;
+  *          --bench arena        compares libsodium and arena hashing (page faults, latency);
+  *          --keys <n>           number of keys used by benchmarks (default 10M, 16 for batch).
+  * @param argc The number of command-line arguments.
+  * @param argv The command-line arguments.
+  * @return 0 on successful execution.
+  */
+ int main(int argc, char* argv[]) {
+     if (!PasswordHasher::initialize()) return 1;
+ 
+     map<string, string> options = parseOptions(argc, argv);
+     unsigned long long cacheMb = 8, hashMemoryMb = 1024;
+     unsigned long lanes = 1, tokenMinutes = 15, concurrency = max(1u, thread::hardware_concurrency());
+     size_t keys = 0;  // 0: each benchmark's own default
+     double userRate = 10, globalRate = 2, verifiedTtl = 0, target = 500;
+     if (!numberOption(options, "cache-mb", cacheMb, 0ull, 1ull << 20) ||
+         !numberOption(options, "hash-memory-mb", hashMemoryMb, 1ull, 1ull << 22) ||
+         !numberOption(options, "lanes", lanes, 1ul, 0xFFFFFFul) ||  // Argon2 allows 2^24 - 1
+         !numberOption(options, "token-minutes", tokenMinutes, 1ul, 366ul * 24 * 60) ||
+         !numberOption(options, "concurrency", concurrency, 1ul, 4096ul) ||
+         !numberOption(options, "keys", keys, size_t(1), size_t(1000000000)) ||
+         !numberOption(options, "user-rate", userRate, 0.01, 1e9) ||
+         !numberOption(options, "global-rate", globalRate, 0.01, 1e9) ||
+         !numberOption(options, "verified-ttl", verifiedTtl, 0.0, 86400.0) ||
+         !numberOption(options, "target-ms", target, 1.0, 600000.0))
+         return 1;
+ 
+     if (options.count("cache-mb")) Database::setCacheBudget(cacheMb * 1024 * 1024);
+     if (options.count("lanes")) PasswordHasher::setLanes(lanes);
+     if (options.count("user-rate")) PasswordHasher::limiter().setUserRate(userRate, max(1.0, userRate / 2));
+     if (options.count("global-rate"))
+         PasswordHasher::limiter().setGlobalRate(globalRate, max(1.0, 2 * globalRate));
+     if (options.count("token-minutes")) SessionTokens::setTtl(chrono::minutes(tokenMinutes));
+     if (options.count("verified-ttl"))
+         PasswordHasher::verified().setTtl(chrono::milliseconds(long(verifiedTtl * 1000)));
+     if (options.count("hash-memory-mb")) PasswordHasher::admission().setBudget(hashMemoryMb * 1024 * 1024);
+     if (options.count("arenas")) PasswordHasher::useArenas();
+ 
+     if (options.count("calibrate")) {
+         Terminal::printInfo("Calibrating Argon2 for p99 <= " + to_string(int(target)) + " ms at " +
+                             to_string(concurrency) + " concurrent hashes");
+         return PasswordHasher::calibrate(target, concurrency) ? 0 : 1;
+     } else if (options["bench"] == "mph") {
+         Benchmark::perfectHash(keys ? keys : 10000000);
+         return 0;
+     } else if (options.count("selftest")) {
+         Terminal::printInfo("Argon2 kernel self-test (active: " + Argon2::kernelName(Argon2::activeKernel()) + ")");
+         return Argon2::selfTest() ? 0 : 1;
+     } else if (!options["create-api-key"].empty()) {
+         Database::loadUsers();
+         try {
+             string key = Database::createApiKey(options["create-api-key"]);
+             if (key.empty()) return (Terminal::printError("Could not create an API key for this user"), 1);
+             cout << key << endl;
+             return 0;
+         } catch (const runtime_error& e) {
+             return (Terminal::printError(e.what()), 1);
+         }
+     } else if (!options["revoke-api-key"].empty()) {
+         if (!Database::revokeApiKey(options["revoke-api-key"])) return (Terminal::printError("Unknown API key"), 1);
+         Terminal::printSuccess("API key revoked");
+         return 0;
+     } else if (options["bench"] == "apikey") {
+         string username;
+         try {
+             if (!Database::verifyApiKey(options["api-key"], username))
+                 return (Terminal::printError("--bench apikey needs a valid --api-key <key>"), 1);
+         } catch (const runtime_error& e) {
+             return (Terminal::printError(e.what()), 1);
+         }
+         Benchmark::apiKeys(options["api-key"], keys ? keys : 1000000);
+         return 0;
+     } else if (!options["api-key"].empty()) {
+         string username;
+         try {
+             if (!Database::verifyApiKey(options["api-key"], username))
+                 return (Terminal::printError("Invalid API key"), 1);
+         } catch (const runtime_error& e) {
+             return (Terminal::printError(e.what()), 1);
+         }
+         cout << username << endl;
+         return 0;
+     } else if (options["bench"] == "lockout") {
+         Benchmark::lockouts(keys ? keys : 1000000);
+         return 0;
+     } else if (options["bench"] == "hex") {
+         Benchmark::hex(keys ? keys : 1000000);
+         return 0;
+     } else if (options["bench"] == "kernels") {
+         Benchmark::kernels(keys ? keys : 5);
+         return 0;
+     } else if (options["bench"] == "arena") {
+         Benchmark::arenas(keys ? keys : 5);
+         return 0;
+     } else if (options["bench"] == "batch") {
+         Benchmark::batchVerify(keys ? keys : 16);
+         return 0;
+     } else if (!options["snapshot"].empty()) {
+         Database::loadUsers();
+         if (!Database::saveSnapshot(options["snapshot"])) {
+             Terminal::printError("Could not write snapshot");
+             return 1;
+         }
+         Terminal::printSuccess("Snapshot written");
+         return 0;
+     } else if (!options["replica"].empty()) {
+         if (!Database::openSnapshot(options["replica"])) {
+             Terminal::printError("Could not open snapshot");
+             return 1;
+         }
+     } else if (!options["follow"].empty()) {
+         Database::follow(options["follow"]);
+     } else {
+         Database::loadUsers();
+         Database::trackFailures();
+     }
+ 
+     while (true) {
+         Terminal::printHeader("Secure Authentication System");
+         Database::CacheStats cache = Database::cacheStats();
+         cout << TerminalColors::Bold << "[Main Menu]\n" << TerminalColors::Reset
+              << "Registered users: " << Database::userCount() << "\n"
+              << "Cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+              << cache.evictions << " evictions\n";
+         if (Database::isFollower()) {
+             Database::ReplicationLag lag = Database::replicationLag();
+             cout << "Replication lag: " << lag.bytesBehind << " bytes, "
+                  << lag.secondsBehind << " s\n";
+         }
+         cout << "\n"
+              << "1. Login\n2. Register\n3. Resume session\n4. Exit\n\nChoice (1-4): ";
+ 
+         int choice;
+         if (!(cin >> choice)) {
+             cin.clear();
+             cin.ignore(numeric_limits<streamsize>::max(), '\n');
+             Terminal::printError("Invalid input");
+             this_thread::sleep_for(chrono::seconds(1));
+             continue;
+         }
+         cin.ignore();
+ 
+         switch (choice) {
+             case 1:
+                 loginScreen();
+                 break;
+             case 2:
+                 registrationScreen();
+                 break;
+             case 3:
+                 sessionScreen();
+                 break;
+             case 4:
+                 Database::close();
                  Terminal::printSuccess("Goodbye!");
                  return 0;
              default: